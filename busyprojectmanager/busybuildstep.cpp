@@ -47,7 +47,15 @@
 static const char BUSY_CONFIG[] = "Busy.Configuration";
 static const char BUSY_STOP_ON_ERRORS[] = "Busy.StopOnErrors";
 static const char BUSY_TRACK_HEADERS[] = "Busy.TrackHeaders";
+static const char BUSY_DEP_SCHEDULING[] = "Busy.DependencyScheduling";
+static const char BUSY_COMPARE_CONTENTS[] = "Busy.CompareContents";
+static const char BUSY_TRACK_COMMANDS[] = "Busy.TrackCommands";
+static const char BUSY_COMPILER_DEPS[] = "Busy.CompilerDeps";
+static const char BUSY_WRITE_TRACE[] = "Busy.WriteTrace";
 static const char BUSY_MAXJOBCOUNT[] = "Busy.MaxJobs";
+static const char BUSY_CACHE_DIR[] = "Busy.CacheDir";
+static const char BUSY_CACHE_SIZE[] = "Busy.CacheSize";
+static const char BUSY_TIMEOUT[] = "Busy.Timeout";
 static const char BUSY_SHOWCOMMANDLINES[] = "Busy.ShowCommandLines";
 static const char BUSY_INSTALL[] = "Busy.Install";
 static const char BUSY_CLEAN_INSTALL_ROOT[] = "Busy.CleanInstallRoot";
@@ -123,6 +131,7 @@ bool BusyBuildStep::init()
 void BusyBuildStep::run(QFutureInterface<bool> &fi)
 {
     m_fi = &fi;
+    m_runningOutput.clear();
 
     build();
 }
@@ -177,6 +186,31 @@ bool BusyBuildStep::trackHeaders() const
     return m_qbsBuildOptions.d_trackHeaders;
 }
 
+bool BusyBuildStep::dependencyScheduling() const
+{
+    return m_qbsBuildOptions.d_depSched;
+}
+
+bool BusyBuildStep::compareContents() const
+{
+    return m_qbsBuildOptions.d_compareContents;
+}
+
+bool BusyBuildStep::trackCommands() const
+{
+    return m_qbsBuildOptions.d_trackCommands;
+}
+
+bool BusyBuildStep::compilerDeps() const
+{
+    return m_qbsBuildOptions.d_compilerDeps;
+}
+
+bool BusyBuildStep::writeTrace() const
+{
+    return m_qbsBuildOptions.d_trace;
+}
+
 bool BusyBuildStep::showCommandLines() const
 {
     return m_qbsBuildOptions.echoMode() == busy::CommandEchoModeCommandLine;
@@ -199,6 +233,21 @@ int BusyBuildStep::maxJobs() const
     return busy::BuildOptions::defaultMaxJobCount();
 }
 
+QString BusyBuildStep::cacheDir() const
+{
+    return m_qbsBuildOptions.d_cacheDir;
+}
+
+int BusyBuildStep::cacheSize() const
+{
+    return m_qbsBuildOptions.d_cacheSize;
+}
+
+int BusyBuildStep::timeout() const
+{
+    return m_qbsBuildOptions.d_timeout;
+}
+
 bool BusyBuildStep::fromMap(const QVariantMap &map)
 {
     if (!ProjectExplorer::BuildStep::fromMap(map))
@@ -207,7 +256,15 @@ bool BusyBuildStep::fromMap(const QVariantMap &map)
     setBusyConfiguration(map.value(QLatin1String(BUSY_CONFIG)).toMap());
     m_qbsBuildOptions.d_stopOnError = map.value(QLatin1String(BUSY_STOP_ON_ERRORS), true).toBool();
     m_qbsBuildOptions.d_trackHeaders = map.value(QLatin1String(BUSY_TRACK_HEADERS), true).toBool();
+    m_qbsBuildOptions.d_depSched = map.value(QLatin1String(BUSY_DEP_SCHEDULING), false).toBool();
+    m_qbsBuildOptions.d_compareContents = map.value(QLatin1String(BUSY_COMPARE_CONTENTS), false).toBool();
+    m_qbsBuildOptions.d_trackCommands = map.value(QLatin1String(BUSY_TRACK_COMMANDS), true).toBool();
+    m_qbsBuildOptions.d_compilerDeps = map.value(QLatin1String(BUSY_COMPILER_DEPS), false).toBool();
+    m_qbsBuildOptions.d_trace = map.value(QLatin1String(BUSY_WRITE_TRACE), false).toBool();
     m_qbsBuildOptions.setMaxJobCount(map.value(QLatin1String(BUSY_MAXJOBCOUNT)).toInt());
+    m_qbsBuildOptions.d_cacheDir = map.value(QLatin1String(BUSY_CACHE_DIR)).toString();
+    m_qbsBuildOptions.d_cacheSize = map.value(QLatin1String(BUSY_CACHE_SIZE), 5 * 1024).toInt();
+    m_qbsBuildOptions.d_timeout = map.value(QLatin1String(BUSY_TIMEOUT), 240).toInt();
     const bool showCommandLines = map.value(QLatin1String(BUSY_SHOWCOMMANDLINES)).toBool();
     m_qbsBuildOptions.setEchoMode(showCommandLines ? busy::CommandEchoModeCommandLine
                                                    : busy::CommandEchoModeSummary);
@@ -223,7 +280,15 @@ QVariantMap BusyBuildStep::toMap() const
     map.insert(QLatin1String(BUSY_CONFIG), m_qbsConfiguration);
     map.insert(QLatin1String(BUSY_STOP_ON_ERRORS), m_qbsBuildOptions.d_stopOnError);
     map.insert(QLatin1String(BUSY_TRACK_HEADERS), m_qbsBuildOptions.d_trackHeaders);
+    map.insert(QLatin1String(BUSY_DEP_SCHEDULING), m_qbsBuildOptions.d_depSched);
+    map.insert(QLatin1String(BUSY_COMPARE_CONTENTS), m_qbsBuildOptions.d_compareContents);
+    map.insert(QLatin1String(BUSY_TRACK_COMMANDS), m_qbsBuildOptions.d_trackCommands);
+    map.insert(QLatin1String(BUSY_COMPILER_DEPS), m_qbsBuildOptions.d_compilerDeps);
+    map.insert(QLatin1String(BUSY_WRITE_TRACE), m_qbsBuildOptions.d_trace);
     map.insert(QLatin1String(BUSY_MAXJOBCOUNT), m_qbsBuildOptions.maxJobCount());
+    map.insert(QLatin1String(BUSY_CACHE_DIR), m_qbsBuildOptions.d_cacheDir);
+    map.insert(QLatin1String(BUSY_CACHE_SIZE), m_qbsBuildOptions.d_cacheSize);
+    map.insert(QLatin1String(BUSY_TIMEOUT), m_qbsBuildOptions.d_timeout);
     map.insert(QLatin1String(BUSY_SHOWCOMMANDLINES),
                m_qbsBuildOptions.echoMode() == busy::CommandEchoModeCommandLine);
     map.insert(QLatin1String(BUSY_INSTALL), m_qbsBuildOptions.install());
@@ -235,6 +300,13 @@ QVariantMap BusyBuildStep::toMap() const
 void BusyBuildStep::buildingDone(bool success)
 {
     m_lastWasSuccess = success;
+    // Output of canceled commands:
+    foreach (const QStringList &lines, m_runningOutput) {
+        foreach (const QString &line, lines)
+            m_parser->stdError(line);
+        m_parser->flush();
+    }
+    m_runningOutput.clear();
     // Report errors:
     foreach (const busy::ErrorItem &item, m_job->error().items())
         createTaskAndOutput(ProjectExplorer::Task::Error, item.description(),
@@ -271,7 +343,17 @@ void BusyBuildStep::handleCommandDescriptionReport(const QString &highlight, con
 
 void BusyBuildStep::handleProcessResultReport(const busy::ProcessResult &result)
 {
-    bool hasOutput = /*!result.stdOut.isEmpty() ||*/ !result.stdErr.isEmpty();
+    if (!result.finished) {
+        // Shown while the command runs, but parsed when it is finished, so the lines of
+        // concurrent commands don't mix in the parser and multi-line messages stay together
+        foreach (const QString &line, result.stdErr)
+            addOutput(line, ErrorOutput);
+        m_runningOutput[result.job] += result.stdErr;
+        return;
+    }
+    const QStringList shown = m_runningOutput.take(result.job);
+
+    bool hasOutput = /*!result.stdOut.isEmpty() ||*/ !result.stdErr.isEmpty() || !shown.isEmpty();
 
     if (result.success && !hasOutput)
         return;
@@ -285,6 +367,8 @@ void BusyBuildStep::handleProcessResultReport(const busy::ProcessResult &result)
     addOutput(commandline, NormalOutput);
 #endif
 
+    foreach (const QString &line, shown)
+        m_parser->stdError(line);
     foreach (const QString &line, result.stdErr) {
         m_parser->stdError(line);
         addOutput(line, ErrorOutput);
@@ -346,6 +430,46 @@ void BusyBuildStep::setTrackHeaders(bool kg)
     emit busyBuildOptionsChanged();
 }
 
+void BusyBuildStep::setDependencyScheduling(bool on)
+{
+    if (m_qbsBuildOptions.d_depSched == on)
+        return;
+    m_qbsBuildOptions.d_depSched = on;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setCompareContents(bool on)
+{
+    if (m_qbsBuildOptions.d_compareContents == on)
+        return;
+    m_qbsBuildOptions.d_compareContents = on;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setTrackCommands(bool on)
+{
+    if (m_qbsBuildOptions.d_trackCommands == on)
+        return;
+    m_qbsBuildOptions.d_trackCommands = on;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setCompilerDeps(bool on)
+{
+    if (m_qbsBuildOptions.d_compilerDeps == on)
+        return;
+    m_qbsBuildOptions.d_compilerDeps = on;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setWriteTrace(bool on)
+{
+    if (m_qbsBuildOptions.d_trace == on)
+        return;
+    m_qbsBuildOptions.d_trace = on;
+    emit busyBuildOptionsChanged();
+}
+
 void BusyBuildStep::setMaxJobs(int jobcount)
 {
     if (m_qbsBuildOptions.maxJobCount() == jobcount)
@@ -354,6 +478,30 @@ void BusyBuildStep::setMaxJobs(int jobcount)
     emit busyBuildOptionsChanged();
 }
 
+void BusyBuildStep::setCacheDir(const QString& dir)
+{
+    if (m_qbsBuildOptions.d_cacheDir == dir)
+        return;
+    m_qbsBuildOptions.d_cacheDir = dir;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setCacheSize(int megaBytes)
+{
+    if (m_qbsBuildOptions.d_cacheSize == megaBytes)
+        return;
+    m_qbsBuildOptions.d_cacheSize = megaBytes;
+    emit busyBuildOptionsChanged();
+}
+
+void BusyBuildStep::setTimeout(int secs)
+{
+    if (m_qbsBuildOptions.d_timeout == secs)
+        return;
+    m_qbsBuildOptions.d_timeout = secs;
+    emit busyBuildOptionsChanged();
+}
+
 void BusyBuildStep::setShowCommandLines(bool show)
 {
     if (showCommandLines() == show)
@@ -463,7 +611,15 @@ BusyBuildStepConfigWidget::BusyBuildStepConfigWidget(BusyBuildStep *step) :
             this, SLOT(changeBuildVariant(int)));
     connect(m_ui->stopOnError, SIGNAL(toggled(bool)), this, SLOT(changeStopOnError(bool)));
     connect(m_ui->trackHeaders, SIGNAL(toggled(bool)), this, SLOT(changeKeepGoing(bool)));
+    connect(m_ui->depScheduling, SIGNAL(toggled(bool)), this, SLOT(changeDependencyScheduling(bool)));
+    connect(m_ui->compareContents, SIGNAL(toggled(bool)), this, SLOT(changeCompareContents(bool)));
+    connect(m_ui->trackCommands, SIGNAL(toggled(bool)), this, SLOT(changeTrackCommands(bool)));
+    connect(m_ui->compilerDeps, SIGNAL(toggled(bool)), this, SLOT(changeCompilerDeps(bool)));
+    connect(m_ui->writeTrace, SIGNAL(toggled(bool)), this, SLOT(changeWriteTrace(bool)));
     connect(m_ui->jobSpinBox, SIGNAL(valueChanged(int)), this, SLOT(changeJobCount(int)));
+    connect(m_ui->timeoutSpinBox, SIGNAL(valueChanged(int)), this, SLOT(changeTimeout(int)));
+    connect(m_ui->cacheDirEdit, SIGNAL(textChanged(QString)), this, SLOT(changeCacheDir(QString)));
+    connect(m_ui->cacheSizeSpinBox, SIGNAL(valueChanged(int)), this, SLOT(changeCacheSize(int)));
     connect(m_ui->showCommandLinesCheckBox, &QCheckBox::toggled, this,
             &BusyBuildStepConfigWidget::changeShowCommandLines);
     connect(m_ui->installCheckBox, &QCheckBox::toggled, this,
@@ -499,13 +655,22 @@ void BusyBuildStepConfigWidget::updateState()
     if (!m_ignoreChange) {
         m_ui->stopOnError->setChecked(m_step->stopOnError());
         m_ui->trackHeaders->setChecked(m_step->trackHeaders());
+        m_ui->depScheduling->setChecked(m_step->dependencyScheduling());
+        m_ui->compareContents->setChecked(m_step->compareContents());
+        m_ui->trackCommands->setChecked(m_step->trackCommands());
+        m_ui->compilerDeps->setChecked(m_step->compilerDeps());
+        m_ui->writeTrace->setChecked(m_step->writeTrace());
         m_ui->jobSpinBox->setValue(m_step->maxJobs());
+        m_ui->timeoutSpinBox->setValue(m_step->timeout());
+        m_ui->cacheDirEdit->setText(m_step->cacheDir());
+        m_ui->cacheSizeSpinBox->setValue(m_step->cacheSize());
         m_ui->showCommandLinesCheckBox->setChecked(m_step->showCommandLines());
         m_ui->installCheckBox->setChecked(m_step->install());
         m_ui->cleanInstallRootCheckBox->setChecked(m_step->cleanInstallRoot());
         updateTargetEdit(m_step->busyConfiguration());
     }
-
+    // the compiler dependencies are only a different source of the tracked headers
+    m_ui->compilerDeps->setEnabled(m_step->trackHeaders());
 
     const QString buildVariant = m_step->buildVariant();
     const int idx = (buildVariant == QLatin1String(Constants::BUSY_VARIANT_DEBUG)) ? 0 : 1;
@@ -559,6 +724,41 @@ void BusyBuildStepConfigWidget::changeKeepGoing(bool kg)
     m_ignoreChange = false;
 }
 
+void BusyBuildStepConfigWidget::changeDependencyScheduling(bool on)
+{
+    m_ignoreChange = true;
+    m_step->setDependencyScheduling(on);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeCompareContents(bool on)
+{
+    m_ignoreChange = true;
+    m_step->setCompareContents(on);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeTrackCommands(bool on)
+{
+    m_ignoreChange = true;
+    m_step->setTrackCommands(on);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeCompilerDeps(bool on)
+{
+    m_ignoreChange = true;
+    m_step->setCompilerDeps(on);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeWriteTrace(bool on)
+{
+    m_ignoreChange = true;
+    m_step->setWriteTrace(on);
+    m_ignoreChange = false;
+}
+
 void BusyBuildStepConfigWidget::changeJobCount(int count)
 {
     m_ignoreChange = true;
@@ -566,6 +766,27 @@ void BusyBuildStepConfigWidget::changeJobCount(int count)
     m_ignoreChange = false;
 }
 
+void BusyBuildStepConfigWidget::changeCacheDir(const QString& dir)
+{
+    m_ignoreChange = true;
+    m_step->setCacheDir(dir);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeCacheSize(int megaBytes)
+{
+    m_ignoreChange = true;
+    m_step->setCacheSize(megaBytes);
+    m_ignoreChange = false;
+}
+
+void BusyBuildStepConfigWidget::changeTimeout(int secs)
+{
+    m_ignoreChange = true;
+    m_step->setTimeout(secs);
+    m_ignoreChange = false;
+}
+
 void BusyBuildStepConfigWidget::changeInstall(bool install)
 {
     m_ignoreChange = true;
@@ -31,6 +31,8 @@
 
 #include <busytools/busyapi.h>
 
+#include <QHash>
+
 namespace Utils { class FancyLineEdit; }
 
 namespace BusyProjectManager {
@@ -62,10 +64,18 @@ public:
 
     bool stopOnError() const;
     bool trackHeaders() const;
+    bool dependencyScheduling() const;
+    bool compareContents() const;
+    bool trackCommands() const;
+    bool compilerDeps() const;
+    bool writeTrace() const;
     bool showCommandLines() const;
     bool install() const;
     bool cleanInstallRoot() const;
     int maxJobs() const;
+    QString cacheDir() const;
+    int cacheSize() const;
+    int timeout() const;
     QString buildVariant() const;
 
     bool fromMap(const QVariantMap &map);
@@ -93,7 +103,15 @@ private:
 
     void setStopOnError(bool dr);
     void setTrackHeaders(bool kg);
+    void setDependencyScheduling(bool on);
+    void setCompareContents(bool on);
+    void setTrackCommands(bool on);
+    void setCompilerDeps(bool on);
+    void setWriteTrace(bool on);
     void setMaxJobs(int jobcount);
+    void setCacheDir(const QString& dir);
+    void setCacheSize(int megaBytes);
+    void setTimeout(int secs);
     void setShowCommandLines(bool show);
     void setInstall(bool install);
     void setCleanInstallRoot(bool clean);
@@ -116,6 +134,7 @@ private:
     int m_progressBase;
     bool m_lastWasSuccess;
     ProjectExplorer::IOutputParser *m_parser;
+    QHash<int, QStringList> m_runningOutput; // by job, shown but not yet parsed
 
 };
 
@@ -138,7 +157,15 @@ private slots:
     void changeStopOnError(bool dr);
     void changeShowCommandLines(bool show);
     void changeKeepGoing(bool kg);
+    void changeDependencyScheduling(bool on);
+    void changeCompareContents(bool on);
+    void changeTrackCommands(bool on);
+    void changeCompilerDeps(bool on);
+    void changeWriteTrace(bool on);
     void changeJobCount(int count);
+    void changeCacheDir(const QString& dir);
+    void changeCacheSize(int megaBytes);
+    void changeTimeout(int secs);
     void changeInstall(bool install);
     void changeCleanInstallRoot(bool clean);
     void changedParams();
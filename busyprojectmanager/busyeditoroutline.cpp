@@ -45,13 +45,8 @@ void EditorOutline::setFileName(const QString& path)
         return;
 
     connect( p, SIGNAL(projectParsingDone(bool)), this, SLOT(fileUpdated()));
-    beginResetModel();
-    d_imp->d_rows.clear();
-    d_imp->d_eng = p->busyProject().getEngine();
-    d_imp->d_module = d_imp->d_eng->findModule(path);
     d_imp->d_path = path;
-    fill();
-    endResetModel();
+    fileUpdated();
 }
 
 const QString&EditorOutline::getFileName() const
@@ -184,9 +179,20 @@ Qt::ItemFlags EditorOutline::flags(const QModelIndex& index) const
 
 void EditorOutline::fileUpdated()
 {
+    BusyProjectManager::Internal::BusyProject* p =
+            qobject_cast<BusyProjectManager::Internal::BusyProject *>(
+                ProjectExplorer::SessionManager::instance()->projectForFile(
+                    Utils::FileName::fromString(d_imp->d_path)));
     beginResetModel();
     d_imp->d_rows.clear();
-    fill();
+    // each parse creates a new engine, and there is none while the snapshot is shown
+    d_imp->d_eng = p ? p->busyProject().getEngine() : 0;
+    d_imp->d_module = 0;
+    if( d_imp->d_eng.constData() )
+    {
+        d_imp->d_module = d_imp->d_eng->findModule(d_imp->d_path);
+        fill();
+    }
     endResetModel();
 }
 
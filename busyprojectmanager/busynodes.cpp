@@ -42,6 +42,7 @@ extern "C" {
 }
 
 #include <QtDebug>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QStyle>
 
@@ -535,21 +536,34 @@ bool BusyProductNode::renameFile(const QString &filePath, const QString &newFile
 
 void BusyProductNode::setBusyProductData(const busy::Project& project, const busy::Product prd)
 {
-    //if (m_qbsProductData == prd)
-    //    return;
+    QString name = prd.name();
+    busy::CodeLocation loc = prd.location();
+    const QStringList files = prd.allFilePaths(prd.isCompiled());
+    bool productIsEnabled = prd.isEnabled();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(name.toUtf8());
+    hash.addData(loc.filePath().toUtf8());
+    hash.addData(QByteArray::number(loc.line()));
+    hash.addData(productIsEnabled ? "1" : "0");
+    foreach (const QString &file, files)
+        hash.addData(file.toUtf8() + '\n');
+    const QByteArray signature = hash.result();
+    if (signature == m_signature) {
+        // the product was reevaluated, but nothing shown in the tree changed
+        m_qbsProductData = prd;
+        return;
+    }
+    m_signature = signature;
 
     bool productWasEnabled = m_qbsProductData.isValid() && m_qbsProductData.isEnabled();
-    bool productIsEnabled = prd.isEnabled();
     bool updateExisting = productWasEnabled != productIsEnabled;
-
-    QString name = prd.name();
 #if 0
     const QString alt = prd.name(true);
     if( name != alt )
         name = QString("%1 (%2)").arg(name).arg(alt);
 #endif
     setDisplayName(name);
-    busy::CodeLocation loc = prd.location();
     setPath(Utils::FileName::fromString(loc.filePath()));
     const QString productPath = QFileInfo(loc.filePath()).absolutePath();
 
@@ -566,7 +580,7 @@ void BusyProductNode::setBusyProductData(const busy::Project& project, const bus
     QList<ProjectExplorer::ProjectNode *> toAdd;
     QList<ProjectExplorer::ProjectNode *> toRemove = subProjectNodes();
 
-    BusyGroupNode::setupFiles(this, prd, prd.allFilePaths(prd.isCompiled()), productPath, updateExisting);
+    BusyGroupNode::setupFiles(this, prd, files, productPath, updateExisting);
 
     addProjectNodes(toAdd);
     removeProjectNodes(toRemove);
@@ -119,6 +119,7 @@ private:
     //BusyGroupNode *findGroupNode(const QString &name);
 
     busy::Product m_qbsProductData;
+    QByteArray m_signature; // of what the node shows, to skip unchanged products on reparse
     static QIcon m_productIcon;
 };
 
@@ -73,6 +73,8 @@ extern "C" {
 #include <QDir>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QCryptographicHash>
+#include <QtConcurrentRun>
 #include <QVariantMap>
 
 using namespace Core;
@@ -105,6 +107,9 @@ BusyProject::BusyProject(BusyManager *manager, const QString &fileName) :
     m_fileName(fileName),
     m_rootProjectNode(0),
     m_busyUpdateFutureInterface(0),
+    m_parserRunning(false),
+    m_parsePending(false),
+    m_pendingForce(false),
     m_currentBc(0),
     d_lastParseOk(false)
 {
@@ -126,6 +131,8 @@ BusyProject::BusyProject(BusyManager *manager, const QString &fileName) :
     connect(this, SIGNAL(environmentChanged()), this, SLOT(delayParsing()));
 
     connect(&m_parsingDelay, SIGNAL(timeout()), this, SLOT(startParsing()));
+    connect(&m_parserWatcher, SIGNAL(finished()), this, SLOT(handleParserFinished()));
+    connect(&m_snapshotWatcher, SIGNAL(finished()), this, SLOT(handleSnapshotLoaded()));
 
     updateDocuments(QSet<QString>() << fileName);
 
@@ -136,6 +143,9 @@ BusyProject::BusyProject(BusyManager *manager, const QString &fileName) :
 BusyProject::~BusyProject()
 {
     m_codeModelFuture.cancel();
+    m_nextProgress.cancel();
+    m_parserWatcher.waitForFinished();
+    m_snapshotWatcher.waitForFinished();
     if (m_busyUpdateFutureInterface) {
         m_busyUpdateFutureInterface->reportCanceled();
         m_busyUpdateFutureInterface->reportFinished();
@@ -401,7 +411,7 @@ busy::BuildJob *BusyProject::build(const busy::BuildOptions &opts, QStringList p
     QTC_ASSERT(busyProject().isValid(), return 0);
     QTC_ASSERT(!isParsing(), return 0);
 
-    if( m_parsingDelay.isActive() && !parseCurrentBuildConfiguration() )
+    if( m_parsingDelay.isActive() && !parseCurrentBuildConfiguration(true, false) )
         return 0; // we cannot build since the config has errors
 
     if( !d_lastParseOk )
@@ -550,7 +560,7 @@ void BusyProject::startParsing()
     }
 #endif
 
-    parseCurrentBuildConfiguration();
+    parseCurrentBuildConfiguration(false, false);
 }
 
 void BusyProject::delayParsing()
@@ -558,7 +568,7 @@ void BusyProject::delayParsing()
     m_parsingDelay.start();
 }
 
-bool BusyProject::parseCurrentBuildConfiguration()
+bool BusyProject::parseCurrentBuildConfiguration(bool wait, bool force)
 {
     if (!activeTarget())
         return false;
@@ -566,7 +576,7 @@ bool BusyProject::parseCurrentBuildConfiguration()
     if (!bc)
         return false;
 
-    return parse(bc->busyConfiguration(), bc->environment(), bc->buildDirectory().toString());
+    return parse(bc->busyConfiguration(), bc->environment(), bc->buildDirectory().toString(), wait, force);
 }
 
 void BusyProject::updateAfterBuild()
@@ -628,12 +638,66 @@ QString BusyProject::uniqueProductName(const busy::Product &product)
     return name;
 }
 
-bool BusyProject::parse(const QVariantMap &config, const Environment &env, const QString &dir)
+static QString snapshotPath(const QString &buildDir)
 {
-    prepareForParsing();
+    return QDir(buildDir).absoluteFilePath(QLatin1String("busy-project.snapshot"));
+}
+
+static QByteArray parseFingerprint(const busy::SetupProjectParameters &params,
+                                   const QSet<QString> &busyFiles)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(params.projectFilePath.toUtf8());
+    hash.addData(params.buildDir.toUtf8());
+    hash.addData(params.buildVariant.toUtf8());
+    hash.addData(params.compilerCommand.toUtf8());
+    hash.addData(params.toolchain.toUtf8());
+    hash.addData(params.version.toUtf8());
+    hash.addData(params.abi.toString().toUtf8());
+    for (int i = 0; i < params.params.size(); i++)
+        hash.addData(params.params[i].first + '=' + params.params[i].second + '\n');
+    foreach (const QByteArray &target, params.targets)
+        hash.addData(target + '\n');
+    QStringList env = params.env.toStringList();
+    env.sort();
+    foreach (const QString &var, env)
+        hash.addData(var.toUtf8() + '\n');
+    QStringList files = busyFiles.toList();
+    files.sort();
+    foreach (const QString &path, files) {
+        hash.addData(path.toUtf8());
+        QFile f(path);
+        if (f.open(QIODevice::ReadOnly))
+            hash.addData(&f);
+        else
+            hash.addData("\0", 1);
+    }
+    return hash.result();
+}
 
+bool BusyProject::parse(const QVariantMap &config, const Environment &env, const QString &dir,
+                        bool wait, bool force)
+{
     m_parsingDelay.stop();
 
+    if (m_parserRunning) {
+        // only one engine evaluates at a time; the running one is abandoned and we start over
+        m_nextProgress.cancel();
+        m_pendingForce = m_pendingForce || force;
+        if (!wait) {
+            m_parsePending = true;
+            return true;
+        }
+        // the caller needs the result now, so start over right here
+        m_parsePending = false;
+        m_parserWatcher.waitForFinished();
+        m_parserRunning = false;
+        m_nextProject = busy::Project();
+        m_nextProgress = QFutureInterface<bool>();
+        force = m_pendingForce;
+        m_pendingForce = false;
+    }
+
     ProjectExplorer::Kit *kit = activeTarget()->kit();
     Q_ASSERT(kit);
 
@@ -675,16 +739,134 @@ bool BusyProject::parse(const QVariantMap &config, const Environment &env, const
     }else
         params.env = env.toProcessEnvironment();
 
-    d_lastParseOk = m_project.parse(params, BusyManager::logSink());
+    prepareForParsing();
+
+    if (!m_rootModule.isValid() && !m_snapshotWatcher.isRunning()) {
+        // show the tree of the last session while the parser validates and replaces it
+        const QString fileName = m_fileName;
+        m_snapshotWatcher.setFuture(QtConcurrent::run([fileName, params]() {
+            busy::Project snapshot(fileName);
+            QByteArray key;
+            if (snapshot.loadSnapshot(snapshotPath(params.buildDir), key)
+                    && key == parseFingerprint(params, snapshot.buildSystemFiles()))
+                return snapshot;
+            return busy::Project();
+        }));
+    }
+
+    // BUSY evaluates the whole module tree at once, so we can only skip it as a whole if neither
+    // the parameters nor any BUSY file changed since the last successful parse; the files are
+    // hashed by the worker and the GUI only waits for the result.
+    // m_project stays valid and is replaced when the parser is finished.
+    const QSet<QString> busyFiles = d_lastParseOk ? m_project.buildSystemFiles() : QSet<QString>();
+    const QByteArray previous = d_lastParseOk && !force ? m_parseFingerprint : QByteArray();
+    params.expectedModules = busyFiles.size();
+    busy::Project next(m_fileName);
+    busy::ILogSink* logSink = BusyManager::logSink();
+    QFutureInterface<bool> progress = *m_busyUpdateFutureInterface;
+    QObject* project = this;
+    m_nextProject = next;
+    m_nextProgress = progress;
+    m_parserRunning = true;
+    m_parserWatcher.setFuture(QtConcurrent::run([next, params, busyFiles, previous, logSink,
+                                                 progress, project]() mutable {
+        BusyParseResult res;
+        const QByteArray fingerprint = parseFingerprint(params, busyFiles);
+        if (!previous.isEmpty() && fingerprint == previous) {
+            res.success = true;
+            res.skipped = true;
+            res.fingerprint = fingerprint;
+            return res;
+        }
+        // queued before the warnings the log sink reports during the parse
+        QMetaObject::invokeMethod(project, "clearBuildSystemTasks", Qt::QueuedConnection);
+        res.success = next.parse(params, logSink, &progress);
+        if (!res.success || progress.isCanceled())
+            return res;
+        // the fingerprint was taken before the parse, so changes during the parse are not missed
+        const QSet<QString> files = next.buildSystemFiles();
+        QByteArray key;
+        if (files == busyFiles) {
+            res.fingerprint = fingerprint;
+            key = fingerprint;
+        } else
+            key = parseFingerprint(params, files); // the BUSY files are only known now
+        // the snapshot is only an accelerator, so failing to write it is not an error
+        if (QDir().mkpath(params.buildDir))
+            next.saveSnapshot(snapshotPath(params.buildDir), key);
+        return res;
+    }));
 
     emit projectParsingStarted();
-    handleBusyParsingDone(d_lastParseOk);
+    if (!wait)
+        return true;
+    m_parserWatcher.waitForFinished();
+    handleParserFinished();
     return d_lastParseOk;
 }
 
-void BusyProject::prepareForParsing()
+void BusyProject::handleParserFinished()
+{
+    if (!m_parserRunning)
+        return; // already handled by a waiting parse()
+    m_parserRunning = false;
+    const bool canceled = m_nextProgress.isCanceled();
+    const BusyParseResult res = m_parserWatcher.result();
+    busy::Project next = m_nextProject;
+    m_nextProject = busy::Project();
+    m_nextProgress = QFutureInterface<bool>();
+
+    if (m_parsePending) {
+        m_parsePending = false;
+        const bool force = m_pendingForce;
+        m_pendingForce = false;
+        parseCurrentBuildConfiguration(false, force);
+        return;
+    }
+    if (canceled || res.skipped) {
+        // the user canceled or nothing changed; keep the previous result
+        if (m_busyUpdateFutureInterface) {
+            if (canceled)
+                m_busyUpdateFutureInterface->reportCanceled();
+            m_busyUpdateFutureInterface->reportFinished();
+            delete m_busyUpdateFutureInterface;
+            m_busyUpdateFutureInterface = 0;
+        }
+        emit projectParsingDone(!canceled);
+        return;
+    }
+    m_project = next;
+    d_lastParseOk = res.success;
+    m_parseFingerprint = res.success ? res.fingerprint : QByteArray();
+    handleBusyParsingDone(d_lastParseOk);
+}
+
+void BusyProject::handleSnapshotLoaded()
+{
+    const busy::Project snapshot = m_snapshotWatcher.result();
+    // too late if the parser already delivered the real tree
+    if (snapshot.isValid() && m_parserRunning && !m_rootModule.isValid())
+        showSnapshot(snapshot);
+}
+
+void BusyProject::clearBuildSystemTasks()
 {
     TaskHub::clearTasks(ProjectExplorer::Constants::TASK_CATEGORY_BUILDSYSTEM);
+}
+
+void BusyProject::showSnapshot(const busy::Project &snapshot)
+{
+    m_project = snapshot;
+    m_rootModule = m_project.topModule();
+    m_rootProjectNode->update();
+    updateDocuments(m_project.buildSystemFiles());
+    updateCppCodeModel();
+    updateBuildTargetData();
+    emit fileListChanged();
+}
+
+void BusyProject::prepareForParsing()
+{
     if (m_busyUpdateFutureInterface) {
         m_busyUpdateFutureInterface->reportCanceled();
         m_busyUpdateFutureInterface->reportFinished();
@@ -733,17 +915,63 @@ void BusyProject::updateCppCodeModel()
     if (!m_rootModule.isValid())
         return;
 
-    m_codeModelFuture.cancel();
-
     CppTools::CppModelManager *modelmanager = CppTools::CppModelManager::instance();
     CppTools::ProjectInfo pinfo(this);
     CppTools::ProjectPartBuilder ppBuilder(pinfo);
 
     ppBuilder.setQtVersion(CppTools::ProjectPart::Qt5);
 
-    QHash<QString, QString> uiFiles;
+    // like BusyProductNode, reuse the parts of products whose signature did not change
+    QHash<QString, CodeModelProduct> products;
+    bool changed = !m_codeModelProjectInfo.isValid();
+    QByteArray toolChain; // the parts also carry the flags and macros of the kit's tool chain
+    if (ProjectExplorer::Kit *kit = activeTarget() ? activeTarget()->kit() : 0) {
+        if (ProjectExplorer::ToolChain *tc = ProjectExplorer::ToolChainKitInformation::toolChain(kit))
+            toolChain = tc->typeId().name() + tc->compilerCommand().toString().toUtf8();
+        toolChain += ProjectExplorer::SysRootKitInformation::sysRoot(kit).toString().toUtf8();
+    }
     foreach (const busy::Product &prd, m_project.allProducts(busy::Project::CompiledProducts,true)) {
         const busy::PropertyMap &props = prd.buildConfig();
+        const QString projectFile = QString::fromLatin1("%1:%2:%3")
+                .arg(prd.location().filePath())
+                .arg(prd.location().line())
+                .arg(prd.location().column());
+        const QStringList files = prd.allFilePaths(true, true);
+              // we need the project headers here, otherwise
+              // BaseEditorDocumentParser::determineProjectPart
+              // doesn't find a header in CppModelManager::projectPart
+              // and makes an expensive dependency calc or a guess
+              // we also need the generated files
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(toolChain);
+        hash.addData(prd.qualident().toUtf8());
+        hash.addData(projectFile.toUtf8());
+        const int keys[] = { busy::PropertyMap::CXXFLAGS, busy::PropertyMap::CFLAGS,
+                             busy::PropertyMap::DEFINES, busy::PropertyMap::INCLUDEPATHS,
+                             busy::PropertyMap::SYSTEM_INCLUDEPATHS,
+                             busy::PropertyMap::FRAMEWORKPATHS,
+                             busy::PropertyMap::SYSTEM_FRAMEWORKPATHS };
+        for (unsigned int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            hash.addData(QByteArray::number(keys[i]));
+            foreach (const QString &p, props.properties[keys[i]])
+                hash.addData(p.toUtf8() + '\n');
+        }
+        foreach (const QString &f, files)
+            hash.addData(f.toUtf8() + '\n');
+
+        const QString key = uniqueProductName(prd);
+        CodeModelProduct product = m_codeModelProducts.value(key);
+        if (product.signature == hash.result() && !products.contains(key)) {
+            foreach (const CppTools::ProjectPart::Ptr &part, product.parts)
+                pinfo.appendProjectPart(part);
+            foreach (Id language, product.languages)
+                setProjectLanguage(language, true);
+            products.insert(key, product);
+            continue;
+        }
+        changed = true;
+        const int firstPart = pinfo.projectParts().size();
 
         ppBuilder.setCxxFlags(props.properties[busy::PropertyMap::CXXFLAGS]);
         ppBuilder.setCFlags(props.properties[busy::PropertyMap::CFLAGS]);
@@ -782,22 +1010,23 @@ void BusyProject::updateCppCodeModel()
         //ppBuilder.setPreCompiledHeaders(pch);
 
         ppBuilder.setDisplayName(prd.qualident()); // prd.name(true));
-        ppBuilder.setProjectFile(QString::fromLatin1("%1:%2:%3")
-                .arg(prd.location().filePath())
-                .arg(prd.location().line())
-                .arg(prd.location().column()));
+        ppBuilder.setProjectFile(projectFile);
 
-        const QStringList files = prd.allFilePaths(true, true);
-              // we need the project headers here, otherwise
-              // BaseEditorDocumentParser::determineProjectPart
-              // doesn't find a header in CppModelManager::projectPart
-              // and makes an expensive dependency calc or a guess
-              // we also need the generated files
-
-        const QList<Id> languages = ppBuilder.createProjectPartsForFiles(files);
-        foreach (Id language, languages)
+        product.signature = hash.result();
+        product.languages = ppBuilder.createProjectPartsForFiles(files);
+        product.parts = pinfo.projectParts().mid(firstPart);
+        foreach (Id language, product.languages)
             setProjectLanguage(language, true);
+        if (!products.contains(key))
+            products.insert(key, product);
     }
+    if (products.size() != m_codeModelProducts.size())
+        changed = true; // a product was removed
+    m_codeModelProducts = products;
+    if (!changed)
+        return; // the code model already has exactly these parts
+
+    m_codeModelFuture.cancel();
 
     pinfo.finish();
 
@@ -37,6 +37,7 @@
 #include <busytools/busyapi.h>
 
 #include <QFuture>
+#include <QFutureWatcher>
 #include <QTimer>
 
 namespace Core { class IDocument; }
@@ -49,6 +50,14 @@ class BusyProjectNode;
 class BusyRootProjectNode;
 class BusyBuildConfiguration;
 
+struct BusyParseResult
+{
+    bool success;
+    bool skipped; // neither the parameters nor a BUSY file changed since the last parse
+    QByteArray fingerprint; // empty if it cannot be trusted for the next parse
+    BusyParseResult():success(false),skipped(false){}
+};
+
 class BusyProject : public ProjectExplorer::Project
 {
     Q_OBJECT
@@ -82,7 +91,7 @@ public:
     QString profileForTarget(const ProjectExplorer::Target *t) const;
     bool isParsing() const;
     bool hasParseResult() const;
-    bool parseCurrentBuildConfiguration();
+    bool parseCurrentBuildConfiguration(bool wait = false, bool force = true);
     void updateAfterBuild();
 
     busy::Module busyModule() const;
@@ -107,6 +116,9 @@ signals:
 
 private slots:
     void handleBusyParsingDone(bool success);
+    void handleParserFinished();
+    void handleSnapshotLoaded();
+    void clearBuildSystemTasks();
 
     void targetWasAdded(ProjectExplorer::Target *t);
     void changeActiveTarget(ProjectExplorer::Target *t);
@@ -116,9 +128,11 @@ private slots:
 private:
     RestoreResult fromMap(const QVariantMap &map, QString *errorMessage);
 
-    bool parse(const QVariantMap &config, const Utils::Environment &env, const QString &dir);
+    bool parse(const QVariantMap &config, const Utils::Environment &env, const QString &dir,
+               bool wait, bool force);
 
     void prepareForParsing();
+    void showSnapshot(const busy::Project &snapshot);
     void updateDocuments(const QSet<QString> &files);
     void updateCppCodeModel();
     void updateCppCompilerCallData();
@@ -137,9 +151,24 @@ private:
     BusyRootProjectNode *m_rootProjectNode;
 
     QFutureInterface<bool> *m_busyUpdateFutureInterface;
+    QFutureWatcher<BusyParseResult> m_parserWatcher;
+    QFutureWatcher<busy::Project> m_snapshotWatcher;
+    busy::Project m_nextProject; // being parsed by m_parserWatcher
+    QFutureInterface<bool> m_nextProgress;
+    bool m_parserRunning;
+    bool m_parsePending; // parse again when the running parser is finished
+    bool m_pendingForce; // of the pending parse
+    QByteArray m_parseFingerprint; // of the parameters and BUSY files of the last successful parse
 
     QFuture<void> m_codeModelFuture;
     CppTools::ProjectInfo m_codeModelProjectInfo;
+    struct CodeModelProduct
+    {
+        QByteArray signature;
+        QList<CppTools::ProjectPart::Ptr> parts;
+        QList<Core::Id> languages;
+    };
+    QHash<QString, CodeModelProduct> m_codeModelProducts; // by uniqueProductName
 
     BusyBuildConfiguration *m_currentBc;
 
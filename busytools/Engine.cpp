@@ -15,7 +15,9 @@
 */
 
 #include "Engine.h"
+#include <QDir>
 #include <QFile>
+#include <QMutex>
 #include <QtDebug>
 #include <stdarg.h>
 extern "C" {
@@ -31,16 +33,81 @@ extern "C" {
 
 using namespace busy;
 
+// The BUSY C library keeps paths in one global buffer, and the projects are parsed in worker
+// threads; so the evaluation and execution of BUSY code are serialized. The queries of an
+// evaluated engine don't use the library for paths (see denormalizePath and joinPath), so the
+// GUI thread never waits for a running parse.
+static QMutex s_libraryMutex(QMutex::Recursive);
+
+// a relative path of a BUSY file, resolved against the normalized directory of its module
+static QString joinPath(const QByteArray& dir, const QByteArray& path)
+{
+    if( dir.isEmpty() || path.startsWith('/') )
+        return Engine::denormalizePath(path);
+    return QDir::cleanPath(Engine::denormalizePath(dir) + QLatin1Char('/') + QString::fromUtf8(path));
+}
+
 class Engine::Imp
 {
 public:
     lua_State *L;
     BSLogger logger;
     void* loggerData;
-
-    Imp():logger(0),loggerData(0){}
+    BSParseMonitor monitor;
+    void* monitorData;
+    enum { ParsePhases = 4 };
+    int modulesKnown; // by the previous parse, the evaluation takes one step per module
+    int modulesDone;
+    int refsSeen; // the declarations registered in #refs which were checked for modules
+
+    Imp():logger(0),loggerData(0),monitor(0),monitorData(0),modulesKnown(0),modulesDone(0),refsSeen(0){}
     bool ok() const { return L != 0; }
 
+    bool progress(int phase)
+    {
+        // the phases after the first one follow the evaluation of the modules
+        return monitor == 0 || monitor(phase > 1 ? phase + modulesKnown : phase,
+                                       ParsePhases + modulesKnown, monitorData);
+    }
+
+    bool evaluating()
+    {
+        if( monitor == 0 )
+            return true;
+        if( modulesKnown == 0 )
+            return monitor(-1, ParsePhases, monitorData);
+        // the parser registers each declaration in #refs when it is evaluated
+        lua_pushstring(L,"#refs");
+        lua_rawget(L,LUA_GLOBALSINDEX);
+        if( lua_istable(L,-1) )
+        {
+            const int n = lua_objlen(L,-1);
+            for( ; refsSeen < n; refsSeen++ )
+            {
+                lua_rawgeti(L,-1,refsSeen + 1);
+                if( lua_istable(L,-1) )
+                {
+                    lua_getfield(L,-1,"#kind");
+                    if( lua_tointeger(L,-1) == BS_ModuleDef )
+                        modulesDone++;
+                    lua_pop(L,1);
+                }
+                lua_pop(L,1);
+            }
+        }
+        lua_pop(L,1);
+        return monitor(1 + qMin(modulesDone, modulesKnown), ParsePhases + modulesKnown, monitorData);
+    }
+
+    static void hook(lua_State* L, lua_Debug*)
+    {
+        lua_getfield(L, LUA_REGISTRYINDEX, "#engine");
+        Imp* _this = (Imp*)lua_touserdata(L,-1);
+        lua_pop(L,1);
+        if( _this && !_this->evaluating() )
+            luaL_error(L, "parsing canceled");
+    }
+
     void error(const char* file, int row, int col, const char* format, ... )
     {
         if( logger == 0 )
@@ -170,7 +237,30 @@ void Engine::registerLogger(BSLogger l, void* data)
     }
 }
 
-bool Engine::parse(const ParseParams& params, bool checkTargets)
+bool Engine::parse(const ParseParams& params, bool checkTargets, BSParseMonitor monitor, void* data)
+{
+    QMutexLocker lock(&s_libraryMutex);
+    d_imp->monitor = monitor;
+    d_imp->monitorData = data;
+    d_imp->modulesKnown = qMax(0, params.expected_modules);
+    d_imp->modulesDone = 0;
+    d_imp->refsSeen = 0;
+    if( monitor )
+    {
+        // poll for cancellation while the BUSY files are evaluated
+        lua_pushlightuserdata(d_imp->L, d_imp);
+        lua_setfield(d_imp->L, LUA_REGISTRYINDEX, "#engine");
+        lua_sethook(d_imp->L, Imp::hook, LUA_MASKCOUNT, 10000);
+    }
+    const bool res = parseImp(params, checkTargets);
+    if( monitor )
+        lua_sethook(d_imp->L, 0, 0, 0);
+    d_imp->monitor = 0;
+    d_imp->monitorData = 0;
+    return res;
+}
+
+bool Engine::parseImp(const ParseParams& params, bool checkTargets)
 {
 
     lua_pushstring(d_imp->L,params.build_mode.constData());
@@ -186,6 +276,11 @@ bool Engine::parse(const ParseParams& params, bool checkTargets)
 
     if( !loadLib(d_imp->L,source,"builtins") )
         return false;
+    if( !d_imp->progress(1) )
+    {
+        lua_pop(d_imp->L,1); // builtins
+        return false;
+    }
     const int builtins = lua_gettop(d_imp->L);
     lua_pushvalue(d_imp->L,builtins);
     lua_setglobal(d_imp->L,"#builtins");
@@ -254,7 +349,7 @@ bool Engine::parse(const ParseParams& params, bool checkTargets)
         }
     }
     bool res = true;
-    if( d_imp->call(3,0,params.root_source_dir) )
+    if( d_imp->call(3,0,params.root_source_dir) && d_imp->progress(2) )
     {
         if( checkTargets )
         {
@@ -277,10 +372,14 @@ bool Engine::parse(const ParseParams& params, bool checkTargets)
             if( d_imp->call(3,1,params.root_source_dir) )
             {
                 const int array = lua_gettop(d_imp->L);
-                lua_pushcfunction(d_imp->L, bs_markAllActive);
-                lua_pushvalue(d_imp->L,array);
-                lua_createtable(d_imp->L,0,0);
-                res = d_imp->call(2,0,params.root_source_dir);
+                if( d_imp->progress(3) )
+                {
+                    lua_pushcfunction(d_imp->L, bs_markAllActive);
+                    lua_pushvalue(d_imp->L,array);
+                    lua_createtable(d_imp->L,0,0);
+                    res = d_imp->call(2,0,params.root_source_dir) && d_imp->progress(4);
+                }else
+                    res = false;
                 lua_pop(d_imp->L,1); // array
             }else
                 res = false;
@@ -302,6 +401,7 @@ extern "C" {
 
 QByteArrayList Engine::generateBuildCommands(const QByteArrayList& targets)
 {
+    QMutexLocker lock(&s_libraryMutex);
     QByteArrayList list;
     bs_preset_runcmd(d_imp->L,runcmd, &list);
     lua_pushcfunction(d_imp->L, bs_execute);
@@ -325,6 +425,7 @@ QByteArrayList Engine::generateBuildCommands(const QByteArrayList& targets)
 
 bool Engine::createBuildDirs()
 {
+    QMutexLocker lock(&s_libraryMutex);
     if( !d_imp->ok() )
         return false;
 
@@ -343,6 +444,7 @@ bool Engine::createBuildDirs()
 
 bool Engine::visit(BSBeginOp b, BSOpParam p, BSEndOp e, BSForkGroup g, void* data, const QByteArrayList& targets)
 {
+    QMutexLocker lock(&s_libraryMutex);
     if( !d_imp->ok() )
         return false;
 
@@ -509,7 +611,7 @@ QString Engine::findPathByPos(const QString& path, int row, int col) const
             lua_rawget(d_imp->L,list_of_idents);
             if( lua_isstring(d_imp->L,-1) )
             {
-                res = QString::fromUtf8(bs_denormalize_path(lua_tostring(d_imp->L,-1)));
+                res = denormalizePath(lua_tostring(d_imp->L,-1));
             }
             lua_pop(d_imp->L,1);
         }
@@ -759,13 +861,7 @@ QStringList Engine::getAllSources(int product, bool addGenerated) const
             for( int i = 1; i <= n; i++ )
             {
                 lua_rawgeti(d_imp->L,sources,i);
-                const int file = lua_gettop(d_imp->L);
-                if( *lua_tostring(d_imp->L,file) != '/' )
-                {
-                    if( bs_add_path(d_imp->L,absDir,file) == 0 )
-                        lua_replace(d_imp->L,file);
-                }
-                res << QString::fromUtf8( bs_denormalize_path(lua_tostring(d_imp->L,file)) );
+                res << joinPath(lua_tostring(d_imp->L,absDir), lua_tostring(d_imp->L,-1));
 
                 lua_pop(d_imp->L,1);
             }
@@ -779,13 +875,7 @@ QStringList Engine::getAllSources(int product, bool addGenerated) const
             for( int i = 1; i <= n; i++ )
             {
                 lua_rawgeti(d_imp->L,generated,i);
-                const int file = lua_gettop(d_imp->L);
-                if( *lua_tostring(d_imp->L,file) != '/' )
-                {
-                    if( bs_add_path(d_imp->L,absDir,file) == 0 )
-                        lua_replace(d_imp->L,file);
-                }
-                res << QString::fromUtf8( bs_denormalize_path(lua_tostring(d_imp->L,file)) );
+                res << joinPath(lua_tostring(d_imp->L,absDir), lua_tostring(d_imp->L,-1));
 
                 lua_pop(d_imp->L,1);
             }
@@ -821,14 +911,8 @@ static void fetchConfig(lua_State* L,int inst, const char* field, QStringList& r
     {
         lua_rawgeti(L,list,i);
         const int item = lua_gettop(L);
-        if( isPath && *lua_tostring(L,-1) != '/' )
-        {
-            // relative path
-            if( bs_add_path(L,absDir,item) == 0 )
-                lua_replace(L,item);
-        }
         if( isPath )
-            result << QString::fromUtf8( bs_denormalize_path(lua_tostring(L,item)) );
+            result << joinPath(lua_tostring(L,absDir), lua_tostring(L,item));
         else
             result << QString::fromUtf8( lua_tostring(L,item) );
         lua_pop(L,1); // path
@@ -997,7 +1081,7 @@ QString Engine::getPath(int def, const char* field) const
         lua_getfield(d_imp->L,-1,field);
         const QByteArray res = lua_tostring(d_imp->L,-1);
         lua_pop(d_imp->L,2);
-        return QString::fromUtf8(bs_denormalize_path(res.constData()));
+        return denormalizePath(res);
     }
     return QString();
 }
@@ -1098,6 +1182,7 @@ void Engine::dump(int def, const char* title) const
 
 bool Engine::build(const QByteArrayList& targets, BSRunCmd runcmd, void* data)
 {
+    QMutexLocker lock(&s_libraryMutex);
     bs_preset_runcmd(d_imp->L,runcmd, data);
     lua_pushcfunction(d_imp->L, bs_execute);
     lua_getglobal(d_imp->L,"#root");
@@ -1117,6 +1202,21 @@ bool Engine::build(const QByteArrayList& targets, BSRunCmd runcmd, void* data)
     return d_imp->call(2,0);
 }
 
+QString Engine::denormalizePath(const QByteArray& path)
+{
+    // like bs_denormalize_path, which uses the global buffer; a normalized absolute path is
+    // the native one with a leading "//", i.e. "//c:/..." on Windows
+    if( !path.startsWith("//") )
+        return QString::fromUtf8(path);
+#ifdef Q_OS_WIN
+    if( path.size() > 3 && QChar(path[2]).isLetter() && path[3] == ':' )
+        return QString::fromUtf8(path.mid(2));
+    return QString::fromUtf8(path); // a UNC path
+#else
+    return QString::fromUtf8(path.mid(1));
+#endif
+}
+
 bool Engine::pushInst(int ref) const
 {
     int n = 1;
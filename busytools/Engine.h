@@ -24,6 +24,9 @@
 extern "C" {
 typedef int (*BSRunCmd)(const char* cmd, void* data);
 }
+// called with the number of finished parse phases and evaluated modules, or with done < 0
+// while evaluating if the number of modules is unknown; returning false aborts the parse
+typedef bool (*BSParseMonitor)(int done, int total, void* data);
 namespace busy
 {
 class Engine : public QSharedData
@@ -61,10 +64,11 @@ public:
         QByteArray wordsize;
         QList<QPair<QByteArray,QByteArray> > params;
         QByteArrayList targets;
-        ParseParams():tcver(0){}
+        int expected_modules; // by the previous parse, for the progress report
+        ParseParams():tcver(0),expected_modules(0){}
     };
 
-    bool parse( const ParseParams& params, bool checkTargets = true );
+    bool parse( const ParseParams& params, bool checkTargets = true, BSParseMonitor = 0, void* data = 0 );
     bool build( const QByteArrayList& targets, BSRunCmd, void* data );
     QByteArrayList generateBuildCommands(const QByteArrayList& targets = QByteArrayList());
     bool createBuildDirs();
@@ -91,12 +95,14 @@ public:
     QByteArray getDeclPath(int decl) const;
     int getInteger(int def, const char* field) const;
     QString getPath(int def, const char* field) const;
+    static QString denormalizePath(const QByteArray& path); // thread-safe
     int getObject(int def, const char* field) const;
     int getGlobals() const;
     int getOwningModule(int def) const;
     int getOwner(int def) const;
     void dump(int def, const char* title = "") const;
 protected:
+    bool parseImp( const ParseParams& params, bool checkTargets );
     bool pushInst(int ref) const;
     int assureRef(int table) const;
 private:
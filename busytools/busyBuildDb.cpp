@@ -0,0 +1,148 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "busyBuildDb.h"
+#include <utils/db/database.h>
+#include <QDir>
+#include <QtDebug>
+using namespace busy;
+
+BuildDb::BuildDb():d_db(0)
+{
+}
+
+BuildDb::~BuildDb()
+{
+    close();
+}
+
+bool BuildDb::open(const QString& buildDir)
+{
+    close();
+    d_db = new Utils::Database();
+    if( !d_db->open(QDir(buildDir).absoluteFilePath(fileName())) )
+    {
+        qWarning() << "cannot open build database in" << buildDir;
+        delete d_db;
+        d_db = 0;
+        return false;
+    }
+    d_db->exec("PRAGMA synchronous=OFF");
+    d_db->exec("CREATE TABLE IF NOT EXISTS Outputs ( "
+               "Path TEXT PRIMARY KEY, "
+               "Inputs BLOB, "
+               "Command BLOB )");
+    d_db->exec("CREATE TABLE IF NOT EXISTS Durations ( "
+               "Path TEXT PRIMARY KEY, "
+               "Millis INTEGER )");
+    d_db->exec("CREATE TABLE IF NOT EXISTS Deps ( "
+               "Path TEXT PRIMARY KEY, "
+               "Headers TEXT )");
+    // all changes of a build run are committed at once in close()
+    d_db->exec("BEGIN TRANSACTION");
+    return true;
+}
+
+void BuildDb::close()
+{
+    if( d_db == 0 )
+        return;
+    d_db->exec("COMMIT");
+    delete d_db;
+    d_db = 0;
+}
+
+bool BuildDb::getRecord(const QByteArray& outfile, BuildDb::Record& rec)
+{
+    if( d_db == 0 )
+        return false;
+    Utils::Query q(d_db, "SELECT Inputs, Command FROM Outputs WHERE Path = ?");
+    q.bind(0, QString::fromUtf8(outfile));
+    if( !q.next() )
+        return false;
+    rec.inputs = q.bytes(0);
+    rec.command = q.bytes(1);
+    return true;
+}
+
+void BuildDb::setRecord(const QByteArray& outfile, const BuildDb::Record& rec)
+{
+    if( d_db == 0 )
+        return;
+    Utils::Query q(d_db, "INSERT OR REPLACE INTO Outputs VALUES (?, ?, ?)");
+    q.bind(0, QString::fromUtf8(outfile));
+    q.bind(1, rec.inputs);
+    q.bind(2, rec.command);
+    q.exec();
+}
+
+void BuildDb::removeRecord(const QByteArray& outfile)
+{
+    if( d_db == 0 )
+        return;
+    Utils::Query q(d_db, "DELETE FROM Outputs WHERE Path = ?");
+    q.bind(0, QString::fromUtf8(outfile));
+    q.exec();
+}
+
+QHash<QByteArray,int> BuildDb::getDurations()
+{
+    QHash<QByteArray,int> res;
+    if( d_db == 0 )
+        return res;
+    Utils::Query q(d_db, "SELECT Path, Millis FROM Durations");
+    while( q.next() )
+        res.insert(q.text(0).toUtf8(), q.number(1));
+    return res;
+}
+
+void BuildDb::setDuration(const QByteArray& outfile, int ms)
+{
+    if( d_db == 0 )
+        return;
+    Utils::Query q(d_db, "INSERT OR REPLACE INTO Durations VALUES (?, ?)");
+    q.bind(0, QString::fromUtf8(outfile));
+    q.bind(1, ms);
+    q.exec();
+}
+
+bool BuildDb::getDeps(const QByteArray& outfile, QStringList& headers)
+{
+    if( d_db == 0 )
+        return false;
+    Utils::Query q(d_db, "SELECT Headers FROM Deps WHERE Path = ?");
+    q.bind(0, QString::fromUtf8(outfile));
+    if( !q.next() )
+        return false;
+    const QString text = q.text(0);
+    headers = text.isEmpty() ? QStringList() : text.split(QChar('\n'));
+    return true;
+}
+
+void BuildDb::setDeps(const QByteArray& outfile, const QStringList& headers)
+{
+    if( d_db == 0 )
+        return;
+    Utils::Query q(d_db, "INSERT OR REPLACE INTO Deps VALUES (?, ?)");
+    q.bind(0, QString::fromUtf8(outfile));
+    q.bind(1, headers.join(QChar('\n')));
+    q.exec();
+}
+
+QString BuildDb::fileName()
+{
+    return QLatin1String("busy.db");
+}
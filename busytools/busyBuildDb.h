@@ -0,0 +1,68 @@
+#ifndef BUSYBUILDDB_H
+#define BUSYBUILDDB_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+
+namespace Utils
+{
+class Database;
+}
+
+namespace busy
+{
+// Persistent per build directory state of the Builder, stored in an SQLite file
+class BuildDb
+{
+public:
+    struct Record
+    {
+        QByteArray inputs;  // digest of the input file contents and the headers they include
+        QByteArray command; // digest of the final command line which produced the output
+    };
+
+    BuildDb();
+    ~BuildDb();
+
+    bool open(const QString& buildDir);
+    void close();
+    bool isOpen() const { return d_db != 0; }
+
+    bool getRecord(const QByteArray& outfile, Record& rec);
+    void setRecord(const QByteArray& outfile, const Record& rec);
+    void removeRecord(const QByteArray& outfile);
+
+    // wall clock time in ms the last successful run took to produce the output
+    QHash<QByteArray,int> getDurations();
+    void setDuration(const QByteArray& outfile, int ms);
+
+    // files included by the last successful compile of the output, as reported by the compiler
+    bool getDeps(const QByteArray& outfile, QStringList& headers);
+    void setDeps(const QByteArray& outfile, const QStringList& headers);
+
+    static QString fileName();
+private:
+    Q_DISABLE_COPY(BuildDb)
+    Utils::Database* d_db;
+};
+}
+
+#endif // BUSYBUILDDB_H
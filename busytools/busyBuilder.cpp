@@ -18,7 +18,18 @@
 #include <QDateTime>
 #include <QFileInfo>
 #include <QDir>
+#include <QSet>
+#include <QCryptographicHash>
+#include <QTimer>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
 #include <QtDebug>
+#include <algorithm>
+#include <functional>
 #include <cpptools/cppmodelmanager.h>
 extern "C" {
 #include <bsvisitor.h>
@@ -32,15 +43,61 @@ static void  Builder_lua_reporter(const char* msg, void* data)
 }
 using namespace busy;
 
-class Builder::Runner : public QThread
+QByteArray Builder::Command::digest() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(program.toUtf8());
+    foreach( const QString& arg, arguments )
+    {
+        hash.addData("\0", 1);
+        hash.addData(arg.toUtf8());
+    }
+    hash.addData("\0", 1);
+    hash.addData(rspContent);
+    return hash.result();
+}
+
+// A Runner executes one operation at a time without blocking; external programs are run as
+// asynchronous child processes driven by the event loop of the builder, copy and Lua operations
+// as well as cache lookups are run on the global thread pool.
+class Builder::Runner : public QObject
 {
 public:
+    Builder* d_builder;
     QString d_program;
     QStringList d_arguments;
+    QString d_rspFile;
+    QByteArray d_rspContent;
+    QStringList d_preprocess;
+    QString d_objfile;
+    QString d_depfile;
+    bool d_showIncludes;
+    QStringList d_headers; // reported by the compiler
+    bool d_depsKnown;
+    CompilerCache* d_cache;
     QProcessEnvironment d_env;
     QString d_workdir;
     QStringList d_stdErr;
+    QByteArray d_outfile;
+    BuildDb::Record d_sig;
+    QByteArray d_key;
+    QByteArray d_stdErrBuf; // not yet reported incomplete line
+    QByteArray d_output; // all of stderr, kept with the cached object
+    QProcess* d_proc;
+    QFutureWatcher<void> d_task;
+    std::function<void()> d_then; // continuation when d_task is finished
+    QTimer d_timer;
+    QElapsedTimer d_clock; // since start()
+    qint64 d_started; // ms since start of the build run
+    QString d_product;
+    int d_timeout; // seconds, no timeout if zero
+    int d_node;
+    int d_slot; // index in the pool
+    quint8 d_op;
     bool d_success;
+    bool d_preprocessing;
+    bool d_timedOut;
+    bool d_hit;
 
     static QStringList convert(const QByteArray& str)
     {
@@ -70,17 +127,15 @@ public:
                 file.endsWith(".h++") || file.endsWith(".hp") || file.endsWith(".hxx");
     }
 
-    void prepare( const Operation& op )
+    static Command prepare( const Operation& op, bool compilerDeps )
     {
-        d_stdErr.clear();
-        d_success = true;
-
+        Command cmd;
         if( op.op == BS_Copy )
-            d_program = "copy";
+            cmd.program = "copy";
         else if( op.op == BS_RunLua )
-            d_program = "lua";
+            cmd.program = "lua";
         else
-            d_program = QString::fromUtf8(op.cmd);
+            cmd.program = QString::fromUtf8(op.cmd);
 
         QByteArrayList values;
         QByteArray value;
@@ -98,15 +153,30 @@ public:
             values = op.getParams(BS_include_dir);
             foreach(const QByteArray& v, values )
                 params << QString("-I%1").arg(QString::fromUtf8(v));
+            cmd.objfile = QString::fromUtf8(op.getOutfile());
             switch(op.tc)
             {
             case BS_gcc:
             case BS_clang:
+                cmd.preprocess = params;
+                cmd.preprocess << "-E" << QString::fromUtf8(op.getInfile());
+                if( compilerDeps )
+                {
+                    cmd.depfile = cmd.objfile + ".d";
+                    params << "-MD" << "-MF" << cmd.depfile;
+                }
                 params << "-c" << "-o";
                 params << QString::fromUtf8(op.getOutfile());
                 params << QString::fromUtf8(op.getInfile());
                 break;
             case BS_msvc:
+                cmd.preprocess = params;
+                cmd.preprocess << "/nologo" << "/E" << QString::fromUtf8(op.getInfile());
+                if( compilerDeps )
+                {
+                    cmd.showIncludes = true;
+                    params << "/showIncludes";
+                }
                 params << "/nologo" << "/c";
                 params << QString("/Fo%1").arg(QString::fromUtf8(op.getOutfile()));
                 params << QString::fromUtf8(op.getInfile());
@@ -143,22 +213,20 @@ public:
                 // lines up to a length of 32'767 unicode chars (including terminating zero)
 
                 QFileInfo info(QString::fromUtf8( op.getOutfile() ));
-                QFile rsp(info.absoluteDir().absoluteFilePath(info.completeBaseName() + ".rsp") );
-                if( !rsp.open(QIODevice::WriteOnly) )
-                    qCritical() << "cannot open rsp file for writing:" << rsp.fileName(); // TODO
+                cmd.rspFile = info.absoluteDir().absoluteFilePath(info.completeBaseName() + ".rsp");
                 values = op.getInFiles();
                 foreach(const QByteArray& v, values )
                 {
                     if( op.tc == BS_msvc && v.endsWith(".dll") )
                     {
                         // add .lib because msvc requires an import library to use the dll
-                        rsp.write(v);
-                        rsp.write(".lib");
+                        cmd.rspContent += v;
+                        cmd.rspContent += ".lib";
                     }else
-                        rsp.write(v);
-                    rsp.write(" ");
+                        cmd.rspContent += v;
+                    cmd.rspContent += " ";
                 }
-                params << QString("@%1").arg(rsp.fileName());
+                params << QString("@%1").arg(cmd.rspFile);
             }else
             {
                 values = op.getInFiles();
@@ -242,16 +310,14 @@ public:
                 // lines up to a length of 32'767 unicode chars (including terminating zero)
 
                 QFileInfo info(QString::fromUtf8( op.getOutfile() ));
-                QFile rsp(info.absoluteDir().absoluteFilePath(info.completeBaseName() + ".rsp") );
-                if( !rsp.open(QIODevice::WriteOnly) )
-                    qCritical() << "cannot open rsp file for writing:" << rsp.fileName(); // TODO
+                cmd.rspFile = info.absoluteDir().absoluteFilePath(info.completeBaseName() + ".rsp");
                 values = op.getInFiles();
                 foreach(const QByteArray& v, values )
                 {
-                    rsp.write(v);
-                    rsp.write(" ");
+                    cmd.rspContent += v;
+                    cmd.rspContent += " ";
                 }
-                params << QString("@%1").arg(rsp.fileName());
+                params << QString("@%1").arg(cmd.rspFile);
             }else
             {
                 values = op.getInFiles();
@@ -300,79 +366,362 @@ public:
             params << QString::fromUtf8(op.getOutfile());
             break;
         }
-        d_arguments = params;
+        cmd.arguments = params;
+        return cmd;
     }
 
-    void run()
+    void setCommand( const Command& cmd )
     {
+        d_stdErr.clear();
+        d_success = true;
+        d_program = cmd.program;
+        d_arguments = cmd.arguments;
+        d_rspFile = cmd.rspFile;
+        d_rspContent = cmd.rspContent;
+        d_preprocess = cmd.preprocess;
+        d_objfile = cmd.objfile;
+        d_depfile = cmd.depfile;
+        d_showIncludes = cmd.showIncludes;
+    }
+
+    void start()
+    {
+        d_stdErr.clear();
+        d_stdErrBuf.clear();
+        d_output.clear();
+        d_key.clear();
+        d_success = true;
+        d_preprocessing = false;
+        d_timedOut = false;
+        d_hit = false;
+        d_headers.clear();
+        d_depsKnown = false;
+        d_clock.start();
+
         if( d_program == "copy" )
         {
-            bool ok = true;
-            QFileInfo info(d_arguments[1]);
-            if( info.exists() )
-                ok = QFile::remove(d_arguments[1]);
-            QDir(d_workdir).mkpath(info.absolutePath());
-            if( ok )
-                ok = QFile::copy(d_arguments[0],d_arguments[1]);
-            if( !ok )
-            {
-                d_success = false;
-                d_stdErr << "cannot copy files";
-            }
+            runTask([this]() { copy(); }, [this]() { done(); });
         }else if( d_program == "lua" )
         {
-            QByteArrayList args;
-            foreach( const QString& arg, d_arguments )
-                args << arg.toUtf8();
-            const int argc = args.size() + 1;
-            QVector<const char*> argv(argc + 1);
-            argv[0] = "lua";
-            for( int i = 0; i < args.size(); i++ )
-                argv[i+1] = args[i].constData();
-            argv[argc] = 0;
-
-            d_success == (lua_main_with_reporter(argc, const_cast<char**>(argv.data()),
-                                                Builder_lua_reporter, &d_stdErr ) == 0);
+            runTask([this]() { lua(); }, [this]() { done(); });
         }else
         {
-            QProcess proc;
-            proc.setProcessEnvironment(d_env);
-            proc.setArguments(d_arguments);
-            proc.setProgram(d_program);
-            proc.setWorkingDirectory(d_workdir);
-            proc.start();
-            if( proc.waitForStarted() )
+            if( !d_rspFile.isEmpty() )
             {
-                if( !proc.waitForFinished(240000) )
+                QFile rsp(d_rspFile);
+                if( !rsp.open(QIODevice::WriteOnly) )
                 {
                     d_success = false;
-                    d_stdErr << "process timeout";
-                }else
-                {
-                    d_success = proc.exitCode() == 0;
-                    if( !d_success )
-                        d_stdErr = convert( proc.readAllStandardError() ) + convert( proc.readAllStandardOutput() );
+                    d_stdErr << "cannot open rsp file for writing:" << d_rspFile;
+                    QTimer::singleShot(0, this, [this]() { done(); });
+                    return;
                 }
+                rsp.write(d_rspContent);
+            }
+            d_preprocessing = d_cache && !d_preprocess.isEmpty();
+            startProcess(d_preprocessing ? d_preprocess : d_arguments);
+        }
+    }
+
+    void cancel()
+    {
+        d_timer.stop();
+        d_then = std::function<void()>();
+        if( d_proc )
+        {
+            disconnect(d_proc, 0, this, 0);
+            d_proc->kill();
+            d_proc->waitForFinished(1000);
+            delete d_proc;
+            d_proc = 0;
+        }
+        d_task.waitForFinished();
+    }
+
+    void runTask( const std::function<void()>& task, const std::function<void()>& then )
+    {
+        d_then = then;
+        d_task.setFuture(QtConcurrent::run(task));
+    }
+
+    void onTaskFinished()
+    {
+        // copy first, the continuation might start the next task and replace d_then
+        const std::function<void()> then = d_then;
+        d_then = std::function<void()>();
+        if( then )
+            then();
+    }
+
+    void startProcess( const QStringList& args )
+    {
+        d_proc = new QProcess(this);
+        d_proc->setProcessEnvironment(d_env);
+        d_proc->setArguments(args);
+        d_proc->setProgram(d_program);
+        d_proc->setWorkingDirectory(d_workdir);
+        connect(d_proc, &QProcess::readyReadStandardError, this, [this]() { onStdErr(); });
+        connect(d_proc, static_cast<void (QProcess::*)(int,QProcess::ExitStatus)>(&QProcess::finished),
+                this, [this](int code, QProcess::ExitStatus status) { onProcessFinished(code, status); });
+        connect(d_proc, static_cast<void (QProcess::*)(QProcess::ProcessError)>(&QProcess::error),
+                this, [this](QProcess::ProcessError err) {
+            if( err == QProcess::FailedToStart )
+                onFailedToStart();
+        });
+        d_proc->start();
+        if( d_timeout > 0 )
+            d_timer.start(d_timeout * 1000);
+    }
+
+    void onStdErr()
+    {
+        const QByteArray data = d_proc->readAllStandardError();
+        if( d_preprocessing )
+            return; // the compiler will report the same errors
+        d_output += data;
+        d_stdErrBuf += data;
+        const int pos = d_stdErrBuf.lastIndexOf('\n');
+        if( pos < 0 )
+            return;
+        const QStringList lines = convert(d_stdErrBuf.left(pos));
+        d_stdErrBuf = d_stdErrBuf.mid(pos + 1);
+        emit d_builder->reportOutput(d_slot, lines);
+    }
+
+    void onFailedToStart()
+    {
+        d_timer.stop();
+        d_success = false;
+        d_stdErr << "cannot start process" << d_proc->errorString();
+        d_proc->deleteLater();
+        d_proc = 0;
+        // on some platforms this is called from within QProcess::start
+        QTimer::singleShot(0, this, [this]() { done(); });
+    }
+
+    void onTimeout()
+    {
+        d_timedOut = true;
+        d_proc->kill(); // onProcessFinished follows
+    }
+
+    void onProcessFinished(int code, QProcess::ExitStatus status)
+    {
+        d_timer.stop();
+        QProcess* proc = d_proc;
+        d_proc = 0;
+        proc->deleteLater();
+        if( d_timedOut )
+        {
+            d_success = false;
+            d_stdErr << "process timeout";
+            done();
+        }else if( d_preprocessing )
+        {
+            d_preprocessing = false;
+            if( status == QProcess::NormalExit && code == 0 )
+            {
+                const QByteArray preprocessed = proc->readAllStandardOutput();
+                runTask([this, preprocessed]() {
+                    d_key = d_cache->key(d_program, d_arguments, d_objfile, preprocessed, d_env);
+                    QByteArray output;
+                    d_hit = !d_key.isEmpty() && d_cache->fetch(d_key, d_objfile, &output);
+                    if( d_hit && !output.trimmed().isEmpty() )
+                        d_stdErr = convert(output); // the warnings of the compiler run producing it
+                    if( d_hit && ( !d_depfile.isEmpty() || d_showIncludes ) )
+                    {
+                        // the compiler doesn't run, so take the included files from the line markers
+                        d_headers = includesFromPreprocessed(preprocessed);
+                        d_depsKnown = true;
+                    }
+                }, [this]() {
+                    if( d_hit )
+                        done();
+                    else
+                        startProcess(d_arguments);
+                });
+            }else
+                startProcess(d_arguments); // let the compiler report the error
+        }else
+        {
+            const QByteArray rest = proc->readAllStandardError();
+            d_output += rest;
+            d_stdErrBuf += rest;
+            if( !d_stdErrBuf.trimmed().isEmpty() )
+                d_stdErr = convert(d_stdErrBuf);
+            d_stdErrBuf.clear();
+            d_success = status == QProcess::NormalExit && code == 0;
+            QByteArray out = proc->readAllStandardOutput();
+            if( d_showIncludes )
+                out = takeShowIncludes(out);
+            if( !d_success )
+            {
+                if( !out.trimmed().isEmpty() )
+                    d_stdErr += convert( out );
             }else
             {
-                d_success = false;
-                d_stdErr << "cannot start process" << proc.errorString();
+                if( d_showIncludes )
+                    d_depsKnown = true;
+                else if( !d_depfile.isEmpty() )
+                    d_depsKnown = readDepFile();
+                if( !d_key.isEmpty() )
+                    d_cache->store(d_key, d_objfile, d_output);
             }
+            done();
         }
     }
 
-    Runner(QObject* p):QThread(p),d_success(true) {}
+    void done()
+    {
+        d_builder->onFinished(this);
+    }
+
+    void addHeader( const QString& path )
+    {
+        const QString header = QDir::cleanPath(QDir(d_workdir).absoluteFilePath(path));
+        if( !d_headers.contains(header) )
+            d_headers.append(header);
+    }
+
+    bool readDepFile()
+    {
+        // make rule as written by -MD; blanks in names are escaped, long lines continued by backslash
+        QFile f(d_depfile);
+        if( !f.open(QIODevice::ReadOnly) )
+            return false;
+        const QByteArray rule = f.readAll();
+        int start = -1;
+        for( int i = 0; i < rule.size() - 1; i++ )
+        {
+            // the target ends with the first colon followed by white space (not a drive letter)
+            if( rule[i] == ':' && ( rule[i+1] == ' ' || rule[i+1] == '\t' ||
+                                    rule[i+1] == '\n' || rule[i+1] == '\r' ) )
+            {
+                start = i + 1;
+                break;
+            }
+        }
+        if( start < 0 )
+            return false;
+        QByteArray path;
+        for( int i = start; i < rule.size(); i++ )
+        {
+            const char ch = rule[i];
+            if( ch == '\\' && i + 1 < rule.size() && ( rule[i+1] == '\n' || rule[i+1] == '\r' ) )
+                continue; // line continuation, the line break itself is white space
+            if( ch == '\\' && i + 1 < rule.size() && ( rule[i+1] == ' ' || rule[i+1] == '#' ) )
+                path += rule[++i];
+            else if( ch == '$' && i + 1 < rule.size() && rule[i+1] == '$' )
+                path += rule[++i];
+            else if( ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' )
+            {
+                if( !path.isEmpty() )
+                    addHeader(QString::fromLocal8Bit(path));
+                path.clear();
+            }else
+                path += ch;
+        }
+        if( !path.isEmpty() )
+            addHeader(QString::fromLocal8Bit(path));
+        return true;
+    }
+
+    QByteArray takeShowIncludes( const QByteArray& out )
+    {
+        // cl prints "Note: including file:   path" for each header to stdout
+        static const QByteArray note = "Note: including file:";
+        QByteArray rest;
+        QByteArrayList lines = out.split('\n');
+        foreach( const QByteArray& line, lines )
+        {
+            if( line.startsWith(note) )
+                addHeader(QString::fromLocal8Bit(line.mid(note.size()).trimmed()));
+            else
+            {
+                rest += line;
+                rest += '\n';
+            }
+        }
+        return rest;
+    }
+
+    QStringList includesFromPreprocessed( const QByteArray& text )
+    {
+        // gcc/clang write line markers like '# 1 "path" 2', cl like '#line 1 "path"'
+        QStringList res;
+        QSet<QByteArray> seen;
+        QByteArrayList lines = text.split('\n');
+        foreach( const QByteArray& line, lines )
+        {
+            if( !line.startsWith("#line ") && !( line.size() > 2 && line[0] == '#' &&
+                                                   line[1] == ' ' && line[2] >= '0' && line[2] <= '9' ) )
+                continue;
+            const int from = line.indexOf('"');
+            const int to = line.lastIndexOf('"');
+            if( from < 0 || to <= from )
+                continue;
+            QByteArray path = line.mid(from + 1, to - from - 1);
+            if( path.startsWith('<') || seen.contains(path) )
+                continue; // <built-in>, <command-line>
+            seen.insert(path);
+            path.replace("\\\\", "\\");
+            res << QDir::cleanPath(QDir(d_workdir).absoluteFilePath(QString::fromLocal8Bit(path)));
+        }
+        return res;
+    }
+
+    void copy()
+    {
+        bool ok = true;
+        QFileInfo info(d_arguments[1]);
+        if( info.exists() )
+            ok = QFile::remove(d_arguments[1]);
+        QDir(d_workdir).mkpath(info.absolutePath());
+        if( ok )
+            ok = QFile::copy(d_arguments[0],d_arguments[1]);
+        if( !ok )
+        {
+            d_success = false;
+            d_stdErr << "cannot copy files";
+        }
+    }
+
+    void lua()
+    {
+        QByteArrayList args;
+        foreach( const QString& arg, d_arguments )
+            args << arg.toUtf8();
+        const int argc = args.size() + 1;
+        QVector<const char*> argv(argc + 1);
+        argv[0] = "lua";
+        for( int i = 0; i < args.size(); i++ )
+            argv[i+1] = args[i].constData();
+        argv[argc] = 0;
+
+        d_success = (lua_main_with_reporter(argc, const_cast<char**>(argv.data()),
+                                            Builder_lua_reporter, &d_stdErr ) == 0);
+    }
+
+    Runner(Builder* b):QObject(b),d_builder(b),d_showIncludes(false),d_depsKnown(false),d_cache(0),d_proc(0),d_started(0),d_timeout(0),d_node(-1),
+        d_slot(0),d_op(0),d_success(true),
+        d_preprocessing(false),d_timedOut(false),d_hit(false)
+    {
+        d_timer.setSingleShot(true);
+        connect(&d_timer, &QTimer::timeout, this, [this]() { onTimeout(); });
+        connect(&d_task, &QFutureWatcher<void>::finished, this, [this]() { onTaskFinished(); });
+    }
 };
 
 Builder::Builder(int threadCount, bool stopOnError, bool trackHeaders, QObject *parent)
-    : QThread(parent),d_stopOnError(stopOnError), d_trackHeaders(trackHeaders)
+    : QThread(parent),d_stopOnError(stopOnError), d_trackHeaders(trackHeaders), d_depSched(false),
+      d_compareContents(false), d_trackCommands(true), d_trace(false), d_compilerDeps(false), d_cacheSize(0), d_timeout(240)
 {
     connect(this,SIGNAL(started()), this, SLOT(onStarted()), Qt::QueuedConnection );
     d_pool.resize(threadCount);
     for( int i = 0; i < d_pool.size(); i++ )
     {
         d_pool[i] = new Runner(this);
-        connect(d_pool[i],SIGNAL(finished()), this, SLOT(onFinished()));
+        d_pool[i]->d_slot = i;
     }
 }
 
@@ -392,12 +741,30 @@ void Builder::start(const Builder::OpList& work,
     d_curGroup = 0;
     d_done = 0;
     d_title.clear();
+    d_product.clear();
+    d_events.clear();
+    d_clock.start();
     d_available.clear();
     for( int i = 0; i < d_pool.size(); i++ )
         d_available.append(d_pool[i]);
 
-    if( d_trackHeaders )
-        d_deps = CppTools::CppModelManager::instance()->snapshot().dependencyTable();
+    if( d_trackHeaders && !d_compilerDeps )
+    {
+        d_deps = CppTools::CppModelManager::instance()->dependencyTable();
+        d_deps.refreshModified();
+    }
+    else
+        d_deps = CPlusPlus::DependencyTable();
+
+    d_digests.clear();
+    statAll();
+    if( tracking() || d_depSched || ( d_trackHeaders && d_compilerDeps ) )
+        d_db.open(d_workdir);
+    if( !d_cacheDir.isEmpty() && d_cache.open(d_cacheDir, d_cacheSize) )
+        d_cache.resetStats();
+
+    if( d_depSched )
+        buildGraph();
 
     QThread::start();
 }
@@ -406,23 +773,60 @@ void Builder::onCancel()
 {
     d_cancel = true;
     for( int i = 0; i < d_pool.size(); i++ )
-        d_pool[i]->wait();
+        d_pool[i]->cancel();
     if( !isRunning() )
         return;
+    d_db.close();
+    d_cache.close();
     emit taskFinished(false);
     quit();
 }
 
-void Builder::onFinished()
+void Builder::onFinished(Runner* r)
 {
-    Runner* r = (Runner*) sender();
     //qDebug() << "finished" << r;
-    emit reportResult(r->d_success, r->d_stdErr );
+    emit reportResult(r->d_slot, r->d_success, r->d_stdErr );
     if( !r->d_success )
         d_success = false;
+    if( r->d_op == BS_RunLua )
+        d_stamps.clear(); // a script can write any file
+    else
+        d_stamps.remove(QString::fromUtf8(r->d_outfile)); // the output may be the input of another operation
+    if( d_db.isOpen() && !r->d_outfile.isEmpty() )
+    {
+        d_digests.remove(QString::fromUtf8(r->d_outfile));
+        if( r->d_success && tracking() )
+            d_db.setRecord(r->d_outfile, r->d_sig);
+        else if( tracking() )
+            d_db.removeRecord(r->d_outfile);
+        if( r->d_success && !r->d_hit )
+            d_db.setDuration(r->d_outfile, r->d_clock.elapsed());
+        if( r->d_success && r->d_depsKnown )
+            d_db.setDeps(r->d_outfile, r->d_headers);
+    }
+    if( d_trace )
+    {
+        Event e;
+        e.outfile = QString::fromUtf8(r->d_outfile);
+        e.product = r->d_product;
+        e.op = r->d_op;
+        e.slot = r->d_slot;
+        e.start = r->d_started;
+        e.duration = r->d_clock.elapsed();
+        e.success = r->d_success;
+        d_events << e;
+    }
     if( d_cancel )
         return;
     d_available.push_back(r);
+    if( d_depSched )
+        finishNode(r->d_node, r->d_success);
+    if( d_quitting )
+    {
+        if( d_available.size() == d_pool.size() )
+            QMetaObject::invokeMethod(this,"onQuit");
+        return;
+    }
     select();
 }
 
@@ -436,6 +840,20 @@ void Builder::onStarted()
 
 void Builder::onQuit()
 {
+    d_db.close();
+    if( d_cache.isOpen() )
+    {
+        if( d_cache.hits() || d_cache.misses() )
+            emit reportCommandDescription(QString(), QString("    # compiler cache: %1 hits, %2 misses")
+                                          .arg(d_cache.hits()).arg(d_cache.misses()));
+        d_cache.evict();
+        d_cache.close();
+    }
+    if( d_trace && !d_events.isEmpty() )
+    {
+        writeTrace();
+        reportSlowest();
+    }
     emit taskFinished(d_success);
     quit();
 }
@@ -445,13 +863,18 @@ void Builder::select()
     if( d_quitting )
         return;
 
+    if( d_depSched )
+    {
+        selectFromGraph();
+        return;
+    }
+
     if( d_work.isEmpty() || (d_stopOnError && !d_success ) )
     {
         d_quitting = true;
-        for( int i = 0; i < d_pool.size(); i++ )
-            d_pool[i]->wait();
-        // now all onFinished signals are in the queue
-        QMetaObject::invokeMethod(this,"onQuit");
+        // otherwise onFinished quits when the last runner is done
+        if( d_available.size() == d_pool.size() )
+            QMetaObject::invokeMethod(this,"onQuit");
         return;
     }
 
@@ -490,38 +913,37 @@ void Builder::select()
     }
 }
 
-static void dump(const Builder::Operation& op, int nr, bool due )
+const char* Builder::opName(quint8 op)
 {
-    QByteArray prefix;
-    switch(op.op)
+    switch(op)
     {
     case BS_Compile:
-        prefix = "COMPILE: ";
-        break;
+        return "COMPILE";
     case BS_LinkExe:
     case BS_LinkDll:
     case BS_LinkLib:
-        prefix = "LINK: ";
-        break;
+        return "LINK";
     case BS_RunMoc:
-        prefix = "MOC: ";
-        break;
+        return "MOC";
     case BS_RunRcc:
-        prefix = "RCC: ";
-        break;
+        return "RCC";
     case BS_RunUic:
-        prefix = "UIC: ";
-        break;
+        return "UIC";
     case BS_RunLua:
-        prefix = "LUA: ";
-        break;
+        return "LUA";
     case BS_Copy:
-        prefix = "COPY: ";
-        break;
+        return "COPY";
     default:
-        prefix = "BEGIN OP: " + QByteArray::number(op.op) + " ";
-        break;
+        return "BEGIN OP";
     }
+}
+
+static void dump(const Builder::Operation& op, int nr, bool due )
+{
+    QByteArray prefix = Builder::opName(op.op);
+    if( prefix == "BEGIN OP" )
+        prefix += " " + QByteArray::number(op.op);
+    prefix += ": ";
     qDebug() << (due ? "!" : "." ) << nr << prefix.constData() << op.group << op.getOutfile().constData();
 }
 
@@ -533,10 +955,20 @@ bool Builder::startOne()
     if( op.op == BS_EnteringProduct )
     {
         d_title = QString::fromUtf8(op.cmd);
+        d_product = d_title;
         return false;
     }
 
-    const bool due = isDue(op);
+    return startOp(op, -1);
+}
+
+bool Builder::startOp(const Operation& op, int node)
+{
+    const Command cmd = Runner::prepare(op, d_trackHeaders && d_compilerDeps);
+    BuildDb::Record sig;
+    if( tracking() )
+        sig.command = cmd.digest();
+    const bool due = isDue(op, sig);
     //dump(op, d_done-1,due);
     if( !due )
         return false;
@@ -550,9 +982,19 @@ bool Builder::startOne()
 
     Runner* r = d_available.takeFirst();
     //qDebug() << "started" << r;
+    r->d_node = node;
+    r->d_op = op.op;
+    r->d_started = d_clock.elapsed();
+    r->d_product = d_product;
+    if( node >= 0 )
+        r->d_product = d_nodes[node].product >= 0 ? d_products[d_nodes[node].product] : QString();
+    r->d_outfile = op.getOutfile();
+    r->d_sig = sig;
+    r->d_cache = d_cache.isOpen() ? &d_cache : 0;
+    r->d_timeout = d_timeout;
     r->d_env = d_env;
     r->d_workdir = d_workdir;
-    r->prepare(op);
+    r->setCommand(cmd);
     const QString cmdline = r->d_program + QChar(' ') + r->d_arguments.join(' ');
     emit reportCommandDescription(QString(), QString(4,QChar(' ')) + cmdline );
 
@@ -560,7 +1002,215 @@ bool Builder::startOne()
     return true;
 }
 
-bool Builder::isDue(const Builder::Operation& op)
+static inline void insertSorted(QList<int>& l, int i)
+{
+    l.insert(std::lower_bound(l.begin(), l.end(), i) - l.begin(), i);
+}
+
+void Builder::buildGraph()
+{
+    d_nodes.clear();
+    d_nodes.resize(d_work.size());
+    d_ready.clear();
+    d_blocked.clear();
+    d_pendingGens.clear();
+    d_products.clear();
+    d_lastProduct = -1;
+
+    QHash<QByteArray,int> producers; // outfile -> op producing it
+    QList<int> sinceBarrier;
+    int barrier = -1;
+    int product = -1;
+    for( int i = 0; i < d_work.size(); i++ )
+    {
+        const Operation& op = d_work[i];
+        if( op.op == BS_EnteringProduct )
+        {
+            d_products << QString::fromUtf8(op.cmd);
+            product = d_products.size() - 1;
+            d_done++; // nothing to run
+            continue;
+        }
+        Node& n = d_nodes[i];
+        n.product = product;
+        n.generator = op.op == BS_RunMoc || op.op == BS_RunRcc || op.op == BS_RunUic || op.op == BS_Copy;
+        // a source file can include generated files (e.g. ui_*.h or *.moc) which are not declared as inputs
+        n.needsGenerators = op.op == BS_Compile;
+
+        QSet<int> preds;
+        if( op.op == BS_RunLua )
+        {
+            // a Lua script can read and write whatever it wants, so it is a full barrier
+            foreach( int j, sinceBarrier )
+                preds << j;
+            sinceBarrier.clear();
+        }
+        if( barrier >= 0 )
+            preds << barrier;
+        const QByteArrayList infiles = op.getInFiles();
+        foreach( const QByteArray& infile, infiles )
+        {
+            const int j = producers.value(infile, -1);
+            if( j >= 0 )
+                preds << j;
+        }
+        foreach( int j, preds )
+            d_nodes[j].succs << i;
+        n.preds = preds.size();
+
+        const QByteArray outfile = op.getOutfile();
+        if( !outfile.isEmpty() )
+            producers[outfile] = i;
+        if( op.op == BS_RunLua )
+            barrier = i;
+        else
+            sinceBarrier << i;
+        if( n.generator )
+            d_pendingGens << i;
+    }
+
+    estimateCriticalPaths();
+
+    for( int i = 0; i < d_work.size(); i++ )
+    {
+        if( d_work[i].op != BS_EnteringProduct && d_nodes[i].preds == 0 )
+            release(i);
+    }
+}
+
+void Builder::estimateCriticalPaths()
+{
+    const QHash<QByteArray,int> durations = d_db.getDurations();
+
+    // operations not run before are assumed to take the average time of their kind
+    QHash<int,QPair<qint64,int> > sums; // op kind -> sum of ms, count
+    QVector<int> known(d_work.size(), -1);
+    for( int i = 0; i < d_work.size(); i++ )
+    {
+        const Operation& op = d_work[i];
+        if( op.op == BS_EnteringProduct )
+            continue;
+        QHash<QByteArray,int>::const_iterator j = durations.find(op.getOutfile());
+        if( j == durations.end() )
+            continue;
+        known[i] = j.value();
+        QPair<qint64,int>& sum = sums[op.op];
+        sum.first += j.value();
+        sum.second++;
+    }
+
+    // successors always come later in visit order, so a backward pass suffices
+    for( int i = d_work.size() - 1; i >= 0; i-- )
+    {
+        const Operation& op = d_work[i];
+        if( op.op == BS_EnteringProduct )
+            continue;
+        Node& n = d_nodes[i];
+        qint64 ms = known[i];
+        if( ms < 0 )
+        {
+            const QPair<qint64,int> sum = sums.value(op.op);
+            ms = sum.second ? sum.first / sum.second : 1;
+        }
+        qint64 longest = 0;
+        foreach( int succ, n.succs )
+            longest = qMax(longest, d_nodes[succ].critical);
+        n.critical = ms + longest;
+    }
+}
+
+void Builder::selectFromGraph()
+{
+    const bool stop = d_cancel || ( d_stopOnError && !d_success );
+    while( !stop && !d_ready.isEmpty() && !d_available.isEmpty() )
+    {
+        const int node = d_ready.takeFirst();
+        emit taskProgress(++d_done);
+        if( !startNode(node) )
+            finishNode(node, true); // not due, so the successors can go on
+    }
+
+    if( d_available.size() == d_pool.size() && ( stop || d_ready.isEmpty() ) )
+    {
+        // nothing is running anymore and nothing can be started
+        d_quitting = true;
+        QMetaObject::invokeMethod(this,"onQuit");
+    }
+}
+
+bool Builder::startNode(int node)
+{
+    const Node& n = d_nodes[node];
+    d_title.clear();
+    if( n.product >= 0 && n.product != d_lastProduct )
+        d_title = d_products[n.product];
+    if( !startOp(d_work[node], node) )
+        return false;
+    d_lastProduct = n.product;
+    return true;
+}
+
+void Builder::finishNode(int node, bool success)
+{
+    if( node < 0 )
+        return;
+    Node& n = d_nodes[node];
+    if( n.generator )
+    {
+        d_pendingGens.removeOne(node);
+        releaseBlocked();
+    }
+    foreach( int succ, n.succs )
+    {
+        if( !success )
+            skipNode(succ);
+        else if( --d_nodes[succ].preds == 0 && !d_nodes[succ].skipped )
+            release(succ);
+    }
+}
+
+void Builder::skipNode(int node)
+{
+    Node& n = d_nodes[node];
+    if( n.skipped )
+        return;
+    n.skipped = true;
+    if( n.generator )
+    {
+        d_pendingGens.removeOne(node);
+        releaseBlocked();
+    }
+    foreach( int succ, n.succs )
+        skipNode(succ);
+}
+
+void Builder::release(int node)
+{
+    if( d_nodes[node].needsGenerators && !d_pendingGens.isEmpty() && d_pendingGens.first() < node )
+        insertSorted(d_blocked, node);
+    else
+        makeReady(node);
+}
+
+void Builder::releaseBlocked()
+{
+    const int lowest = d_pendingGens.isEmpty() ? d_nodes.size() : d_pendingGens.first();
+    while( !d_blocked.isEmpty() && d_blocked.first() < lowest )
+        makeReady(d_blocked.takeFirst());
+}
+
+void Builder::makeReady(int node)
+{
+    const QVector<Node>& nodes = d_nodes;
+    QList<int>::iterator i = std::lower_bound(d_ready.begin(), d_ready.end(), node, [&nodes](int lhs, int rhs) {
+        if( nodes[lhs].critical != nodes[rhs].critical )
+            return nodes[lhs].critical > nodes[rhs].critical;
+        return lhs < rhs;
+    });
+    d_ready.insert(i, node);
+}
+
+bool Builder::isDue(const Builder::Operation& op, BuildDb::Record& sig)
 {
     if( op.op == BS_RunLua )
         return true;
@@ -568,40 +1218,240 @@ bool Builder::isDue(const Builder::Operation& op)
     const QByteArray outfile = op.getOutfile();
     if( outfile.isEmpty() )
         return true; // cause an error message by the command
-    QFileInfo outinfo( QString::fromUtf8(outfile) );
-    if( !outinfo.exists() )
+
+    if( d_compareContents )
+        sig.inputs = inputDigest(op);
+
+    const qint64 outstamp = stamp(QString::fromUtf8(outfile));
+    if( outstamp < 0 )
     {
         //if( op.op == BS_Compile || op.op == BS_LinkDll || op.op == BS_LinkExe || op.op == BS_LinkLib )
-        //    qDebug() << "compiled or linked because outfile not exists:" << outinfo.absoluteFilePath();
+        //    qDebug() << "compiled or linked because outfile not exists:" << outfile;
         return true;
     }
 
-    const uint ref = outinfo.lastModified().toTime_t();
+    if( d_compareContents && sig.inputs.isEmpty() )
+        return true; // cause an error message by the command
+
+    BuildDb::Record rec;
+    const bool recorded = tracking() && d_db.getRecord(outfile, rec);
+    if( recorded && rec.command != sig.command )
+        return true; // the command changed, e.g. because of a modified define or include path
+    if( recorded && d_compareContents && !rec.inputs.isEmpty() )
+        return rec.inputs != sig.inputs;
+
+    if( anyNewerInput(op, outstamp) )
+        return true;
+    if( tracking() && ( !recorded || d_compareContents ) )
+        d_db.setRecord(outfile, sig); // nothing or no contents recorded yet; adopt the present state
+    return false;
+}
 
+bool Builder::anyNewerInput(const Builder::Operation& op, uint ref)
+{
     const QByteArrayList infiles = op.getInFiles();
     foreach( const QByteArray& infile, infiles )
     {
-        QFileInfo info( QString::fromUtf8(infile) );
-        if( infile.isEmpty() || !info.exists() )
+        const QString path = QString::fromUtf8(infile);
+        const qint64 modified = stamp(path);
+        if( infile.isEmpty() || modified < 0 )
             return true; // cause an error message by the command
-        if( info.lastModified().toTime_t() > ref )
+        if( modified > ref )
         {
             //if( op.op == BS_Compile || op.op == BS_LinkDll || op.op == BS_LinkExe || op.op == BS_LinkLib )
-            //    qDebug() << "compiled or linked" << outinfo.absoluteFilePath() << "because of younger input" << info.fileName();
+            //    qDebug() << "compiled or linked" << op.getOutfile() << "because of younger input" << path;
             return true; // at least one input is newer than existing output
         }
         QString reason;
-        if( d_trackHeaders && op.op == BS_Compile &&
-                d_deps.anyNewerDeps(info.absoluteFilePath(),ref, &reason) )
+        if( d_trackHeaders && !d_compilerDeps && op.op == BS_Compile &&
+                d_deps.anyNewerDeps(QFileInfo(path).absoluteFilePath(),ref, &reason) )
         {
             // also check with include headers (possibly restrict to sourcedir)
-            // qDebug() << "compiled" << info.fileName() << "because of modified header" << reason; // TEST
+            // qDebug() << "compiled" << path << "because of modified header" << reason; // TEST
             return true;
         }
     }
+    if( d_trackHeaders && d_compilerDeps && op.op == BS_Compile )
+    {
+        QStringList headers;
+        if( !d_db.getDeps(op.getOutfile(), headers) )
+            return true; // not yet compiled with dependency output
+        foreach( const QString& header, headers )
+        {
+            const qint64 modified = stamp(header);
+            if( modified < 0 || modified > ref )
+                return true;
+        }
+    }
     return false;
 }
 
+static qint64 statFile(const QString& path)
+{
+    QFileInfo info(path);
+    if( path.isEmpty() || !info.exists() )
+        return -1;
+    return info.lastModified().toTime_t();
+}
+
+void Builder::statAll()
+{
+    // stat all files the up-to-date checks will ask for at once, spread over the thread pool
+    QSet<QString> unique;
+    foreach( const Operation& op, d_work )
+    {
+        if( op.op == BS_EnteringProduct || op.op == BS_RunLua )
+            continue;
+        foreach( const Parameter& p, op.params )
+        {
+            if( p.kind == BS_infile || p.kind == BS_outfile )
+                unique << QString::fromUtf8(p.value);
+        }
+    }
+    const QStringList paths = unique.toList();
+    const QList<qint64> stamps = QtConcurrent::blockingMapped<QList<qint64> >(paths, statFile);
+    d_stamps.clear();
+    d_stamps.reserve(paths.size());
+    for( int i = 0; i < paths.size(); i++ )
+        d_stamps.insert(paths[i], stamps[i]);
+}
+
+qint64 Builder::stamp(const QString& path)
+{
+    QHash<QString,qint64>::const_iterator i = d_stamps.find(path);
+    if( i != d_stamps.end() )
+        return i.value();
+    const qint64 res = statFile(path);
+    d_stamps.insert(path,res);
+    return res;
+}
+
+QByteArray Builder::inputDigest(const Builder::Operation& op)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const QByteArrayList infiles = op.getInFiles();
+    foreach( const QByteArray& infile, infiles )
+    {
+        const QString path = QString::fromUtf8(infile);
+        const QByteArray digest = fileDigest(path);
+        if( infile.isEmpty() || digest.isEmpty() )
+            return QByteArray(); // missing input
+        hash.addData(infile);
+        hash.addData(digest);
+        if( d_trackHeaders && op.op == BS_Compile )
+        {
+            // the set of included headers is part of the digest, not only their contents
+            QStringList headers;
+            if( !d_compilerDeps )
+                headers = d_deps.includedFiles(QFileInfo(path).absoluteFilePath());
+            else if( !d_db.getDeps(op.getOutfile(), headers) )
+                return QByteArray(); // not yet compiled with dependency output
+            foreach( const QString& header, headers )
+            {
+                hash.addData(header.toUtf8());
+                hash.addData(fileDigest(header));
+            }
+        }
+    }
+    return hash.result();
+}
+
+QByteArray Builder::fileDigest(const QString& path)
+{
+    QHash<QString,QByteArray>::const_iterator i = d_digests.find(path);
+    if( i != d_digests.end() )
+        return i.value();
+    QByteArray res;
+    QFile f(path);
+    if( f.open(QIODevice::ReadOnly) )
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(&f);
+        res = hash.result();
+    }
+    d_digests.insert(path,res);
+    return res;
+}
+
+QString Builder::traceFileName()
+{
+    return QLatin1String("busy-trace.json");
+}
+
+void Builder::writeTrace()
+{
+    QJsonArray events;
+    foreach( const Event& e, d_events )
+    {
+        QJsonObject args;
+        args.insert("outfile", e.outfile);
+        args.insert("product", e.product);
+        args.insert("success", e.success);
+        QJsonObject ev;
+        ev.insert("name", QFileInfo(e.outfile).fileName());
+        ev.insert("cat", QString(opName(e.op)));
+        ev.insert("ph", QString("X")); // complete event
+        ev.insert("ts", double(e.start * 1000)); // microseconds
+        ev.insert("dur", double(e.duration * 1000));
+        ev.insert("pid", 1);
+        ev.insert("tid", e.slot);
+        ev.insert("args", args);
+        events.append(ev);
+    }
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QString("ms"));
+
+    const QString path = QDir(d_workdir).absoluteFilePath(traceFileName());
+    QFile out(path);
+    if( !out.open(QIODevice::WriteOnly) )
+    {
+        emit reportCommandDescription(QString(), QString("    # cannot write build trace to %1").arg(path));
+        return;
+    }
+    out.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    emit reportCommandDescription(QString(), QString("    # build trace written to %1").arg(path));
+}
+
+static bool longerThan(const QPair<qint64,QString>& lhs, const QPair<qint64,QString>& rhs)
+{
+    return lhs.first > rhs.first;
+}
+
+void Builder::reportSlowest()
+{
+    const int maxLines = 10;
+
+    QList<QPair<qint64,QString> > tus;
+    QHash<QString,qint64> products;
+    foreach( const Event& e, d_events )
+    {
+        if( e.op == BS_Compile )
+            tus << qMakePair(e.duration, e.outfile);
+        if( !e.product.isEmpty() )
+            products[e.product] += e.duration;
+    }
+    std::sort(tus.begin(), tus.end(), longerThan);
+    QList<QPair<qint64,QString> > prods;
+    QHash<QString,qint64>::const_iterator i;
+    for( i = products.begin(); i != products.end(); ++i )
+        prods << qMakePair(i.value(), i.key());
+    std::sort(prods.begin(), prods.end(), longerThan);
+
+    if( !tus.isEmpty() )
+        emit reportCommandDescription(QString(), "    # slowest translation units:");
+    for( int j = 0; j < tus.size() && j < maxLines; j++ )
+        emit reportCommandDescription(QString(), QString("    #   %1 s  %2")
+                                      .arg(tus[j].first / 1000.0, 7, 'f', 2).arg(tus[j].second));
+    if( !prods.isEmpty() )
+        emit reportCommandDescription(QString(), "    # slowest products (sum of operations):");
+    for( int j = 0; j < prods.size() && j < maxLines; j++ )
+        emit reportCommandDescription(QString(), QString("    #   %1 s  %2")
+                                      .arg(prods[j].first / 1000.0, 7, 'f', 2).arg(prods[j].second));
+    emit reportCommandDescription(QString(), QString("    # total wall clock time %1 s")
+                                  .arg(d_clock.elapsed() / 1000.0, 0, 'f', 2));
+}
+
 QByteArray Builder::Operation::getOutfile() const
 {
     return getParam(BS_outfile);
@@ -20,7 +20,10 @@
 #include <QThread>
 #include <QProcessEnvironment>
 #include <QVector>
+#include <QElapsedTimer>
 #include <cplusplus/DependencyTable.h>
+#include "busyBuildDb.h"
+#include "busyCompilerCache.h"
 
 namespace busy
 {
@@ -55,28 +58,107 @@ public:
     void start( const OpList&, const QString& sourcedir, const QString& workdir,
                 const QProcessEnvironment& env);
 
+    // instead of waiting for all operations of a group to finish, start any operation
+    // as soon as the operations producing its input files are done; ready operations with the
+    // longest path to the end of the build, estimated by durations of previous runs, go first
+    void setDependencyScheduling(bool on) { d_depSched = on; }
+    // decide whether an output is due by comparing digests of its inputs and command with the
+    // ones recorded in the build database instead of comparing file modification times
+    void setCompareContents(bool on) { d_compareContents = on; }
+    // record a digest of the final command of each output and rebuild it if the command changes
+    void setTrackCommands(bool on) { d_trackCommands = on; }
+    // restore object files from a ccache-style cache in dir instead of compiling; empty dir disables it
+    void setCompilerCache(const QString& dir, int maxMegaBytes) { d_cacheDir = dir; d_cacheSize = maxMegaBytes; }
+    // a command running longer than secs is killed; no timeout if zero
+    void setTimeout(int secs) { d_timeout = secs; }
+    // write a Chrome trace (chrome://tracing) of the run to traceFileName() in the build
+    // directory and report the slowest operations and products at the end
+    void setTrace(bool on) { d_trace = on; }
+    // track headers by the dependency lists the compiler writes (-MD or /showIncludes) and which
+    // are stored in the build database, instead of by the code model
+    void setCompilerDeps(bool on) { d_compilerDeps = on; }
+
+    static QString traceFileName();
+    static const char* opName(quint8 op);
+
 signals:
     void taskStarted(const QString& description,int maxValue);
     void taskProgress(int curValue);
     void taskFinished(bool success);
     void reportCommandDescription(const QString& highlight, const QString& message);
-    void reportResult( bool success, const QStringList& stdErr );
+    void reportResult( int job, bool success, const QStringList& stdErr );
+    void reportOutput( int job, const QStringList& stdErr ); // while the command is still running
 
 public slots:
     void onCancel();
 
 protected slots:
-    void onFinished();
     void onStarted();
     void onQuit();
 
+private:
+    class Runner;
+
 protected:
     void select();
+    void onFinished(Runner*);
     bool startOne();
-    bool isDue(const Operation& op);
+    bool startOp(const Operation& op, int node);
+    bool isDue(const Operation& op, BuildDb::Record& sig);
+    bool anyNewerInput(const Operation& op, uint ref);
+    void statAll();
+    qint64 stamp(const QString& path);
+    QByteArray inputDigest(const Operation& op);
+    QByteArray fileDigest(const QString& path);
+
+    void buildGraph();
+    void selectFromGraph();
+    bool startNode(int node);
+    void finishNode(int node, bool success);
+    void skipNode(int node);
+    void release(int node);
+    void releaseBlocked();
+    void makeReady(int node);
+    void estimateCriticalPaths();
+    bool tracking() const { return d_compareContents || d_trackCommands; }
+    void writeTrace();
+    void reportSlowest();
 
 private:
-    class Runner;
+    struct Command
+    {
+        QString program;
+        QStringList arguments;
+        QString rspFile; // written right before the program is started
+        QByteArray rspContent;
+        QStringList preprocess; // arguments to only preprocess the source of a compile
+        QString objfile;
+        QString depfile; // written by the compiler because of -MD
+        bool showIncludes; // the compiler reports the headers on stdout
+        Command():showIncludes(false){}
+        QByteArray digest() const;
+    };
+
+    struct Node
+    {
+        QList<int> succs;
+        int preds; // number of unfinished predecessors
+        int product; // index in d_products or -1
+        qint64 critical; // estimated ms from the start of this node to the end of the build
+        bool generator; // may produce files which are not declared as inputs (e.g. ui_*.h)
+        bool needsGenerators; // waits for all preceding generators
+        bool skipped;
+        Node():preds(0),product(-1),critical(0),generator(false),needsGenerators(false),skipped(false){}
+    };
+    struct Event
+    {
+        QString outfile;
+        QString product;
+        quint8 op;
+        int slot;
+        qint64 start, duration; // ms since start of the run
+        bool success;
+    };
     OpList d_work;
     QString d_sourcedir;
     QString d_workdir;
@@ -86,12 +168,33 @@ private:
     quint32 d_curGroup;
     quint32 d_done;
     CPlusPlus::DependencyTable d_deps;
+    BuildDb d_db;
+    QHash<QString,QByteArray> d_digests; // file path -> content digest, valid during a build run
+    QHash<QString,qint64> d_stamps; // file path -> modification time or -1 if missing, see statAll()
+    CompilerCache d_cache;
+    QString d_cacheDir;
     QString d_title;
+    QVector<Node> d_nodes;
+    QList<int> d_ready; // sorted by descending critical path, then by visit order
+    QList<int> d_blocked; // sorted, ready but waiting for preceding generators
+    QList<int> d_pendingGens; // sorted, unfinished generators
+    QStringList d_products;
+    int d_lastProduct;
+    QString d_product; // of the current group mode operation
+    QList<Event> d_events;
+    QElapsedTimer d_clock; // since start of the run
     bool d_success;
     bool d_cancel;
     bool d_quitting;
     bool d_stopOnError;
     bool d_trackHeaders;
+    bool d_depSched;
+    bool d_compareContents;
+    bool d_trackCommands;
+    bool d_trace;
+    bool d_compilerDeps;
+    int d_cacheSize;
+    int d_timeout;
 };
 }
 
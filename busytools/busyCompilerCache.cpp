@@ -0,0 +1,229 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "busyCompilerCache.h"
+#include <utils/db/database.h>
+#include <QCryptographicHash>
+#include <QProcess>
+#include <QFileInfo>
+#include <QDir>
+#include <QtDebug>
+using namespace busy;
+
+CompilerCache::CompilerCache():d_db(0),d_maxKb(0),d_useCount(0)
+{
+}
+
+CompilerCache::~CompilerCache()
+{
+    close();
+}
+
+bool CompilerCache::open(const QString& dir, int maxMegaBytes)
+{
+    QMutexLocker lock(&d_lock);
+    if( d_db )
+        return true;
+    d_dir = dir;
+    d_maxKb = maxMegaBytes * 1024;
+    if( !QDir().mkpath(d_dir) )
+    {
+        qWarning() << "cannot create compiler cache directory" << d_dir;
+        return false;
+    }
+    d_db = new Utils::Database();
+    if( !d_db->open(QDir(d_dir).absoluteFilePath("index.db")) )
+    {
+        qWarning() << "cannot open compiler cache index in" << d_dir;
+        delete d_db;
+        d_db = 0;
+        return false;
+    }
+    d_db->exec("PRAGMA synchronous=OFF");
+    d_db->exec("CREATE TABLE IF NOT EXISTS Entries ( "
+               "Key TEXT PRIMARY KEY, "
+               "Size INTEGER, " // KB
+               "Used INTEGER )"); // d_useCount, the least recently used entry has the smallest number
+    Utils::Query q(d_db,"SELECT MAX(Used) FROM Entries");
+    if( q.next() )
+        d_useCount = q.number(0);
+    return true;
+}
+
+void CompilerCache::close()
+{
+    QMutexLocker lock(&d_lock);
+    delete d_db;
+    d_db = 0;
+    d_identities.clear();
+}
+
+QByteArray CompilerCache::key(const QString& program, const QStringList& args, const QString& outfile,
+                              const QByteArray& preprocessed, const QProcessEnvironment& env)
+{
+    const QByteArray id = identity(program, env);
+    if( id.isEmpty() )
+        return QByteArray(); // unknown compiler, don't cache
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(id);
+    foreach( const QString& arg, args )
+    {
+        QString tmp = arg;
+        tmp.replace(outfile, QLatin1String("<out>")); // the same object can be used for any output path
+        hash.addData("\0", 1);
+        hash.addData(tmp.toUtf8());
+    }
+    hash.addData("\0", 1);
+    hash.addData(preprocessed);
+    return hash.result().toHex();
+}
+
+bool CompilerCache::fetch(const QByteArray& key, const QString& outfile, QByteArray* output)
+{
+    QMutexLocker lock(&d_lock);
+    if( d_db == 0 )
+        return false;
+    Utils::Query q(d_db,"SELECT Size FROM Entries WHERE Key = ?");
+    q.bind(0, key);
+    const QString path = objectPath(key);
+    if( !q.next() || !QFileInfo(path).exists() )
+    {
+        d_misses.ref();
+        return false;
+    }
+    QFile::remove(outfile);
+    if( !QFile::copy(path, outfile) )
+    {
+        d_misses.ref();
+        return false;
+    }
+    if( output )
+    {
+        QFile f(outputPath(key));
+        if( f.open(QIODevice::ReadOnly) )
+            *output = f.readAll();
+        else
+            output->clear(); // the compiler was silent
+    }
+    Utils::Query u(d_db,"UPDATE Entries SET Used = ? WHERE Key = ?");
+    u.bind(0, ++d_useCount);
+    u.bind(1, key);
+    u.exec();
+    d_hits.ref();
+    return true;
+}
+
+void CompilerCache::store(const QByteArray& key, const QString& outfile, const QByteArray& output)
+{
+    QMutexLocker lock(&d_lock);
+    if( d_db == 0 )
+        return;
+    const QString path = objectPath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile::remove(path);
+    if( !QFile::copy(outfile, path) )
+        return;
+    const QString outPath = outputPath(key);
+    QFile::remove(outPath);
+    if( !output.trimmed().isEmpty() )
+    {
+        QFile f(outPath);
+        if( !f.open(QIODevice::WriteOnly) || f.write(output) != output.size() )
+        {
+            f.close();
+            QFile::remove(outPath);
+            QFile::remove(path); // a hit would lose the warnings
+            return;
+        }
+    }
+    Utils::Query q(d_db,"INSERT OR REPLACE INTO Entries VALUES (?, ?, ?)");
+    q.bind(0, key);
+    q.bind(1, int( ( QFileInfo(path).size() + output.size() + 1023 ) / 1024 ));
+    q.bind(2, ++d_useCount);
+    q.exec();
+}
+
+void CompilerCache::evict()
+{
+    QMutexLocker lock(&d_lock);
+    if( d_db == 0 )
+        return;
+    Utils::Query sum(d_db,"SELECT SUM(Size) FROM Entries");
+    if( !sum.next() )
+        return;
+    int total = sum.number(0);
+    if( total <= d_maxKb )
+        return;
+    // remove the least recently used entries until we are well below the limit
+    const int target = d_maxKb - d_maxKb / 10;
+    QByteArrayList toRemove;
+    Utils::Query q(d_db,"SELECT Key, Size FROM Entries ORDER BY Used");
+    while( total > target && q.next() )
+    {
+        toRemove << q.bytes(0);
+        total -= q.number(1);
+    }
+    d_db->exec("BEGIN TRANSACTION");
+    foreach( const QByteArray& key, toRemove )
+    {
+        QFile::remove(objectPath(key));
+        QFile::remove(outputPath(key));
+        Utils::Query d(d_db,"DELETE FROM Entries WHERE Key = ?");
+        d.bind(0, key);
+        d.exec();
+    }
+    d_db->exec("COMMIT");
+}
+
+void CompilerCache::resetStats()
+{
+    d_hits.store(0);
+    d_misses.store(0);
+}
+
+QString CompilerCache::objectPath(const QByteArray& key) const
+{
+    // like ccache distribute the files over subdirectories to keep directories small
+    return QDir(d_dir).absoluteFilePath(QString::fromLatin1(key.left(2) + "/" + key.mid(2) + ".o"));
+}
+
+QString CompilerCache::outputPath(const QByteArray& key) const
+{
+    return QDir(d_dir).absoluteFilePath(QString::fromLatin1(key.left(2) + "/" + key.mid(2) + ".stderr"));
+}
+
+QByteArray CompilerCache::identity(const QString& program, const QProcessEnvironment& env)
+{
+    {
+        QMutexLocker lock(&d_lock);
+        QHash<QString,QByteArray>::const_iterator i = d_identities.find(program);
+        if( i != d_identities.end() )
+            return i.value();
+    }
+    // the version banner identifies the compiler; cl prints it when called without arguments
+    QProcess proc;
+    proc.setProcessEnvironment(env);
+    proc.setProgram(program);
+    if( QFileInfo(program).baseName().compare(QLatin1String("cl"), Qt::CaseInsensitive) != 0 )
+        proc.setArguments(QStringList() << QLatin1String("--version"));
+    proc.start();
+    QByteArray res;
+    if( proc.waitForFinished() )
+        res = program.toUtf8() + proc.readAllStandardOutput() + proc.readAllStandardError();
+    QMutexLocker lock(&d_lock);
+    d_identities.insert(program, res);
+    return res;
+}
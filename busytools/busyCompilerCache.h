@@ -0,0 +1,72 @@
+#ifndef BUSYCOMPILERCACHE_H
+#define BUSYCOMPILERCACHE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QProcessEnvironment>
+#include <QAtomicInt>
+
+namespace Utils
+{
+class Database;
+}
+
+namespace busy
+{
+// A local object file cache in the style of ccache. The key of an object file is a digest of
+// the compiler identity, the arguments (without the output path) and the preprocessed source.
+// The cache is shared by all runners of a build, so all public methods are thread-safe.
+class CompilerCache
+{
+public:
+    CompilerCache();
+    ~CompilerCache();
+
+    bool open(const QString& dir, int maxMegaBytes);
+    void close();
+    bool isOpen() const { return d_db != 0; }
+
+    QByteArray key(const QString& program, const QStringList& args, const QString& outfile,
+                   const QByteArray& preprocessed, const QProcessEnvironment& env);
+    // output is what the compiler wrote to stderr when it produced the object
+    bool fetch(const QByteArray& key, const QString& outfile, QByteArray* output = 0);
+    void store(const QByteArray& key, const QString& outfile, const QByteArray& output = QByteArray());
+    void evict();
+
+    int hits() const { return d_hits.load(); }
+    int misses() const { return d_misses.load(); }
+    void resetStats();
+private:
+    Q_DISABLE_COPY(CompilerCache)
+    QString objectPath(const QByteArray& key) const;
+    QString outputPath(const QByteArray& key) const;
+    QByteArray identity(const QString& program, const QProcessEnvironment& env);
+
+    QMutex d_lock;
+    Utils::Database* d_db;
+    QString d_dir;
+    int d_maxKb;
+    int d_useCount;
+    QHash<QString,QByteArray> d_identities;
+    QAtomicInt d_hits, d_misses;
+};
+}
+
+#endif // BUSYCOMPILERCACHE_H
@@ -23,6 +23,7 @@ extern "C" {
 }
 #include <QFileInfo>
 #include <QDir>
+#include <QDataStream>
 #include <QtDebug>
 #include <QTextDocument>
 #include <QTextCursor>
@@ -30,13 +31,163 @@ extern "C" {
 #include <math.h>
 using namespace busy;
 
+// the evaluated module and product tree as it was after the last successful parse
+class Internal::Snapshot : public QSharedData
+{
+public:
+    enum { Magic = 0x42534e50, Version = 1 };
+    struct Mod
+    {
+        QString name, busyFile;
+        CodeLocation loc;
+        QList<int> subs; // index in mods
+        QList<int> prods[4]; // index in prods, by Engine::ProductFilter
+    };
+    struct Prod
+    {
+        QString name, altName, qualident, exe, synthExe;
+        CodeLocation loc, endLoc;
+        QStringList sources, generated, includePaths, defines;
+        bool active, runnable, compiled;
+        Prod():active(false),runnable(false),compiled(false){}
+    };
+    QList<Mod> mods; // mods[0] is the top module
+    QList<Prod> prods;
+};
+
+static QDataStream& operator<<(QDataStream& out, const CodeLocation& loc)
+{
+    return out << loc.d_path << qint32(loc.d_row) << qint32(loc.d_col);
+}
+
+static QDataStream& operator>>(QDataStream& in, CodeLocation& loc)
+{
+    qint32 row, col;
+    in >> loc.d_path >> row >> col;
+    loc.d_row = row;
+    loc.d_col = col;
+    return in;
+}
+
+static QDataStream& operator<<(QDataStream& out, const Internal::Snapshot::Mod& m)
+{
+    out << m.name << m.busyFile << m.loc << m.subs;
+    for( int i = 0; i < 4; i++ )
+        out << m.prods[i];
+    return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, Internal::Snapshot::Mod& m)
+{
+    in >> m.name >> m.busyFile >> m.loc >> m.subs;
+    for( int i = 0; i < 4; i++ )
+        in >> m.prods[i];
+    return in;
+}
+
+static QDataStream& operator<<(QDataStream& out, const Internal::Snapshot::Prod& p)
+{
+    return out << p.name << p.altName << p.qualident << p.exe << p.synthExe << p.loc << p.endLoc
+               << p.sources << p.generated << p.includePaths << p.defines
+               << p.active << p.runnable << p.compiled;
+}
+
+static QDataStream& operator>>(QDataStream& in, Internal::Snapshot::Prod& p)
+{
+    return in >> p.name >> p.altName >> p.qualident >> p.exe >> p.synthExe >> p.loc >> p.endLoc
+              >> p.sources >> p.generated >> p.includePaths >> p.defines
+              >> p.active >> p.runnable >> p.compiled;
+}
+
 class Internal::ModuleImp : public QSharedData
 {
 public:
     Engine::Ptr d_eng;
-    int d_id;
+    QExplicitlySharedDataPointer<Snapshot> d_snap; // instead of d_eng if set
+    int d_id; // index in d_snap->mods if d_snap is set
+
+    const Snapshot::Mod* mod() const { return d_snap.data() ? &d_snap->mods[d_id] : 0; }
+
+    static Module create(Snapshot* snap, int index)
+    {
+        Module res;
+        res.d_imp = new ModuleImp();
+        res.d_imp->d_snap = snap;
+        res.d_imp->d_id = index;
+        return res;
+    }
+
+    static int capture(Snapshot* snap, const Module& m, QHash<int,int>& prods);
 };
 
+class Internal::ProductImp : public QSharedData
+{
+public:
+    Engine::Ptr d_eng;
+    QExplicitlySharedDataPointer<Snapshot> d_snap; // instead of d_eng if set
+    int d_id; // index in d_snap->prods if d_snap is set
+
+    const Snapshot::Prod* prod() const { return d_snap.data() ? &d_snap->prods[d_id] : 0; }
+
+    static Product create(Snapshot* snap, int index)
+    {
+        Product res;
+        res.d_imp = new ProductImp();
+        res.d_imp->d_snap = snap;
+        res.d_imp->d_id = index;
+        return res;
+    }
+
+    static Snapshot::Prod capture(const Product& p)
+    {
+        Snapshot::Prod res;
+        res.name = p.name();
+        res.altName = p.name(true);
+        res.qualident = p.qualident();
+        res.exe = p.executable(false);
+        res.synthExe = p.executable(true);
+        res.loc = p.location();
+        res.endLoc = p.endLocation();
+        res.sources = p.allFilePaths();
+        res.generated = p.allFilePaths(false,true);
+        const PropertyMap config = p.buildConfig();
+        res.includePaths = config.properties[PropertyMap::INCLUDEPATHS];
+        res.defines = config.properties[PropertyMap::DEFINES];
+        res.active = p.isEnabled();
+        res.runnable = p.isRunnable();
+        res.compiled = p.isCompiled();
+        return res;
+    }
+};
+
+int Internal::ModuleImp::capture(Snapshot* snap, const Module& m, QHash<int,int>& prods)
+{
+    const int index = snap->mods.size();
+    snap->mods.append(Snapshot::Mod());
+    Snapshot::Mod mod;
+    mod.name = m.name();
+    mod.busyFile = m.busyFile();
+    mod.loc = m.location();
+    foreach( const Module& sub, m.subModules() )
+        mod.subs << capture(snap, sub, prods);
+    Engine* eng = m.d_imp->d_eng.data();
+    for( int f = Engine::AllProducts; f <= Engine::Compiled; f++ )
+    {
+        const QList<int> ids = eng->getAllProducts(m.d_imp->d_id, (Engine::ProductFilter)f);
+        for( int i = 0; i < ids.size(); i++ )
+        {
+            if( !prods.contains(ids[i]) )
+            {
+                prods.insert(ids[i], snap->prods.size());
+                snap->prods.append(ProductImp::capture(Product(eng,ids[i])));
+            }
+            mod.prods[f] << prods.value(ids[i]);
+        }
+    }
+    snap->mods[index] = mod;
+    return index;
+}
+
 Module::Module(Engine* eng, int id)
 {
     d_imp = new Internal::ModuleImp();
@@ -74,6 +225,8 @@ QString Module::name() const
 {
     if( !isValid() )
         return QString();
+    if( d_imp->mod() )
+        return d_imp->mod()->name;
     return QString::fromUtf8( d_imp->d_eng->getString(d_imp->d_id,"#name") );
 }
 
@@ -82,9 +235,11 @@ CodeLocation Module::location() const
     CodeLocation res;
     if( !isValid() )
         return res;
+    if( d_imp->mod() )
+        return d_imp->mod()->loc;
     const int owner = d_imp->d_eng->getOwner(d_imp->d_id);
     const QByteArray tmp = d_imp->d_eng->getString(owner ? owner : d_imp->d_id,"#file");
-    res.d_path = QString::fromUtf8( bs_denormalize_path(tmp.constData()) );
+    res.d_path = Engine::denormalizePath(tmp);
     if( owner )
     {
         res.d_col = d_imp->d_eng->getInteger(d_imp->d_id,"#col") + 1;
@@ -98,8 +253,10 @@ QString Module::busyFile() const
     QString res;
     if( !isValid() )
         return res;
+    if( d_imp->mod() )
+        return d_imp->mod()->busyFile;
     const QByteArray tmp = d_imp->d_eng->getString(d_imp->d_id,"#file");
-    res = QString::fromUtf8( bs_denormalize_path(tmp.constData()) );
+    res = Engine::denormalizePath(tmp);
     return res;
 }
 
@@ -113,6 +270,14 @@ QList<Product> Module::products(bool withSourcesOnly) const
     QList<Product> res;
     if( !isValid() )
         return res;
+    if( d_imp->mod() )
+    {
+        const QList<int>& prods = d_imp->mod()->prods[withSourcesOnly ?
+                                                       Engine::WithSources : Engine::AllProducts];
+        for( int i = 0; i < prods.size(); i++ )
+            res << Internal::ProductImp::create(d_imp->d_snap.data(),prods[i]);
+        return res;
+    }
     QList<int> ids = d_imp->d_eng->getAllProducts(d_imp->d_id,withSourcesOnly ?
                                                       Engine::WithSources : Engine::AllProducts );
     for( int i = 0; i < ids.size(); i++ )
@@ -125,6 +290,13 @@ QList<Module> Module::subModules() const
     QList<Module> res;
     if( !isValid() )
         return res;
+    if( d_imp->mod() )
+    {
+        const QList<int>& subs = d_imp->mod()->subs;
+        for( int i = 0; i < subs.size(); i++ )
+            res << Internal::ModuleImp::create(d_imp->d_snap.data(),subs[i]);
+        return res;
+    }
     QList<int> ids = d_imp->d_eng->getSubModules(d_imp->d_id);
     for( int i = 0; i < ids.size(); i++ )
         res << Module(d_imp->d_eng.data(),ids[i]);
@@ -136,6 +308,7 @@ class Internal::ProjectImp : public QSharedData
 public:
     QString d_path;
     Engine::Ptr d_eng;
+    QExplicitlySharedDataPointer<Snapshot> d_snap; // loaded instead of parsed
     ErrorInfo d_errs;
     ILogSink* d_log;
     Engine::ParseParams params;
@@ -203,6 +376,17 @@ public:
 
         // qDebug() << (level == LoggerInfo ? "INF" : tag ) << msg; // TEST
     }
+
+    static bool monitor(int done, int total, void* data)
+    {
+        QFutureInterface<bool>* progress = (QFutureInterface<bool>*)data;
+        if( done >= 0 )
+        {
+            progress->setProgressRange(0, total);
+            progress->setProgressValue(done);
+        }
+        return !progress->isCanceled();
+    }
 };
 
 Project::Project()
@@ -244,6 +428,8 @@ bool Project::isValid() const
 
 Engine*Project::getEngine() const
 {
+    if( d_imp->d_snap.data() )
+        return 0; // not parsed yet
     return d_imp->d_eng.data();
 }
 
@@ -263,7 +449,7 @@ static quint32 parseVersion( const QString& str )
     return res;
 }
 
-bool Project::parse(const SetupProjectParameters& in, ILogSink* logSink)
+bool Project::parse(const SetupProjectParameters& in, ILogSink* logSink, QFutureInterface<bool>* progress)
 {
     if( !isValid() )
         return false;
@@ -271,9 +457,11 @@ bool Project::parse(const SetupProjectParameters& in, ILogSink* logSink)
     ErrorItem err;
     d_imp->d_errs.d_errs.clear();
     d_imp->d_log = logSink;
+    d_imp->d_snap = 0;
 
     d_imp->params.params = in.params;
     d_imp->params.targets = in.targets;
+    d_imp->params.expected_modules = in.expectedModules;
     d_imp->params.root_source_dir = d_imp->d_path.toUtf8();
     d_imp->params.root_build_dir = in.buildDir.toUtf8();
 
@@ -378,7 +566,10 @@ bool Project::parse(const SetupProjectParameters& in, ILogSink* logSink)
 
     d_imp->env = in.env;
 
-    return d_imp->d_eng->parse(d_imp->params);
+    if( progress )
+        return d_imp->d_eng->parse(d_imp->params, true, Internal::ProjectImp::monitor, progress);
+    else
+        return d_imp->d_eng->parse(d_imp->params);
 }
 
 ErrorInfo Project::errors() const
@@ -386,10 +577,57 @@ ErrorInfo Project::errors() const
     return d_imp->d_errs;
 }
 
+bool Project::saveSnapshot(const QString& path, const QByteArray& key) const
+{
+    const Module top = topModule();
+    if( !top.isValid() || d_imp->d_snap.data() )
+        return false;
+    Internal::Snapshot snap;
+    QHash<int,int> prods;
+    Internal::ModuleImp::capture(&snap, top, prods);
+
+    QFile f(path);
+    if( !f.open(QIODevice::WriteOnly) )
+        return false;
+    QDataStream out(&f);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << quint32(Internal::Snapshot::Magic) << quint32(Internal::Snapshot::Version) << key;
+    out << snap.mods << snap.prods;
+    return out.status() == QDataStream::Ok;
+}
+
+bool Project::loadSnapshot(const QString& path, QByteArray& key)
+{
+    if( !isValid() )
+        return false;
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) )
+        return false;
+    QDataStream in(&f);
+    in.setVersion(QDataStream::Qt_5_6);
+    quint32 magic, version;
+    in >> magic >> version;
+    if( magic != Internal::Snapshot::Magic || version != Internal::Snapshot::Version )
+        return false;
+    QExplicitlySharedDataPointer<Internal::Snapshot> snap(new Internal::Snapshot());
+    in >> key >> snap->mods >> snap->prods;
+    if( in.status() != QDataStream::Ok || snap->mods.isEmpty() )
+        return false;
+    d_imp->d_snap = snap;
+    return true;
+}
+
+bool Project::isSnapshot() const
+{
+    return isValid() && d_imp->d_snap.data() != 0;
+}
+
 Module Project::topModule() const
 {
     if( !isValid() )
         return Module();
+    if( d_imp->d_snap.data() )
+        return Internal::ModuleImp::create(d_imp->d_snap.data(),0);
     const int ref = d_imp->d_eng->getRootModule();
     if( ref )
         return Module(d_imp->d_eng.data(), ref);
@@ -397,13 +635,6 @@ Module Project::topModule() const
         return Module();
 }
 
-class Internal::ProductImp : public QSharedData
-{
-public:
-    Engine::Ptr d_eng;
-    int d_id;
-};
-
 Product::Product(Engine* eng, int id)
 {
     d_imp = new Internal::ProductImp();
@@ -430,7 +661,8 @@ Product &Product::operator=(const Product &other)
 
 bool Product::operator==( const Product& rhs ) const
 {
-    return isValid() && d_imp->d_id == rhs.d_imp->d_id;
+    return isValid() && rhs.isValid() && d_imp->d_id == rhs.d_imp->d_id &&
+            d_imp->d_snap == rhs.d_imp->d_snap;
 }
 
 Product::~Product()
@@ -446,6 +678,8 @@ QString Product::name(bool altName) const
 {
     if( !isValid() )
         return QString();
+    if( d_imp->prod() )
+        return altName ? d_imp->prod()->altName : d_imp->prod()->name;
     if( altName )
     {
         const QString name = QString::fromUtf8( d_imp->d_eng->getString(d_imp->d_id,"name",true) );
@@ -459,6 +693,8 @@ QString Product::qualident() const
 {
     if( !isValid() )
         return QString();
+    if( d_imp->prod() )
+        return d_imp->prod()->qualident;
     return QString::fromUtf8( d_imp->d_eng->getDeclPath(d_imp->d_id));
 }
 
@@ -467,11 +703,13 @@ CodeLocation Product::location() const
     CodeLocation res;
     if( !isValid() )
         return res;
+    if( d_imp->prod() )
+        return d_imp->prod()->loc;
     const int owner = d_imp->d_eng->getOwner(d_imp->d_id);
     if( owner == 0 )
         return res;
     const QByteArray tmp = d_imp->d_eng->getString(owner,"#file");
-    res.d_path = QString::fromUtf8( bs_denormalize_path(tmp.constData()) );
+    res.d_path = Engine::denormalizePath(tmp);
     res.d_col = d_imp->d_eng->getInteger(d_imp->d_id,"#col") + 1;
     res.d_row = d_imp->d_eng->getInteger(d_imp->d_id,"#row");
     return res;
@@ -482,6 +720,8 @@ CodeLocation Product::endLocation() const
     CodeLocation res;
     if( !isValid() )
         return res;
+    if( d_imp->prod() )
+        return d_imp->prod()->endLoc;
     const int ctx = d_imp->d_eng->getObject(d_imp->d_id, "#ctr");
     if( ctx )
     {
@@ -510,6 +750,8 @@ bool Product::isEnabled() const
 {
     if( !isValid() )
         return false;
+    if( d_imp->prod() )
+        return d_imp->prod()->active;
     return d_imp->d_eng->isActive(d_imp->d_id);
 }
 
@@ -517,6 +759,8 @@ bool Product::isRunnable() const
 {
     if( !isValid() )
         return false;
+    if( d_imp->prod() )
+        return d_imp->prod()->runnable;
     return d_imp->d_eng->isExecutable(d_imp->d_id);
 }
 
@@ -524,6 +768,8 @@ bool Product::isCompiled() const
 {
     if( !isValid() )
         return false;
+    if( d_imp->prod() )
+        return d_imp->prod()->compiled;
     return d_imp->d_eng->isClass(d_imp->d_id,"CompiledProduct");
 }
 
@@ -561,7 +807,11 @@ QStringList Product::allFilePaths(bool addHeaders, bool addGenerated) const
 {
     if( !isValid() )
         return QStringList();
-    QStringList sources = d_imp->d_eng->getAllSources(d_imp->d_id, addGenerated);
+    QStringList sources;
+    if( d_imp->prod() )
+        sources = addGenerated ? d_imp->prod()->generated : d_imp->prod()->sources;
+    else
+        sources = d_imp->d_eng->getAllSources(d_imp->d_id, addGenerated);
     if( addHeaders )
         return findHeaders(sources) + sources;
     else
@@ -573,6 +823,12 @@ PropertyMap Product::buildConfig() const
     PropertyMap res;
     if( !isValid() )
         return res;
+    if( d_imp->prod() )
+    {
+        res.properties[PropertyMap::INCLUDEPATHS] = d_imp->prod()->includePaths;
+        res.properties[PropertyMap::DEFINES] = d_imp->prod()->defines;
+        return res;
+    }
 
     res.properties[PropertyMap::INCLUDEPATHS] = d_imp->d_eng->getIncludePaths(d_imp->d_id);
     res.properties[PropertyMap::DEFINES] = d_imp->d_eng->getDefines(d_imp->d_id);
@@ -584,6 +840,12 @@ QString Product::executable(bool synthIfEmpty) const
 {
     if( !isValid() )
         return QString();
+    if( d_imp->prod() )
+    {
+        if( d_imp->prod()->exe.isEmpty() && synthIfEmpty )
+            return d_imp->prod()->synthExe;
+        return d_imp->prod()->exe;
+    }
     int id = d_imp->d_eng->getObject(d_imp->d_id,"#inst");
     QString res;
     if( id )
@@ -642,13 +904,12 @@ QProcessEnvironment Project::getRunEnvironment(const Product& product, const Ins
 
 BuildJob* Project::buildAllProducts(const BuildOptions& options, QObject* jobOwner) const
 {
-    if( !isValid() )
+    if( !isValid() || isSnapshot() )
         return 0;
 
     d_imp->d_errs.d_errs.clear();
 
-    return new BuildJob(jobOwner,d_imp->d_eng.data(),d_imp->env, d_imp->params.targets,
-                        options.maxJobCount(), options.d_stopOnError, options.d_trackHeaders);
+    return new BuildJob(jobOwner,d_imp->d_eng.data(),d_imp->env, d_imp->params.targets, options);
 }
 
 BuildJob*Project::buildSomeProducts(const QList<Product>& products, const BuildOptions& options,
@@ -659,7 +920,7 @@ BuildJob*Project::buildSomeProducts(const QList<Product>& products, const BuildO
 
 CleanJob*Project::cleanAllProducts(const CleanOptions& options, QObject* jobOwner)
 {
-    if( !isValid() )
+    if( !isValid() || isSnapshot() )
         return 0;
     return new CleanJob(jobOwner,d_imp->d_eng.data(),d_imp->params.targets);
 }
@@ -737,6 +998,14 @@ static void walkAllProducts(Engine* eng, int module, QList<int>& res, Engine::Pr
     res += eng->getAllProducts(module, filter, onlyActives);
 }
 
+static void walkAllProducts(Internal::Snapshot* snap, int module, QList<int>& res, Engine::ProductFilter filter )
+{
+    const Internal::Snapshot::Mod& m = snap->mods[module];
+    for(int i = 0; i < m.subs.size(); i++ )
+        walkAllProducts(snap,m.subs[i],res,filter);
+    res += m.prods[filter];
+}
+
 QList<Product> Project::allProducts(ProductFilter filter, bool onlyActives) const
 {
     if( !isValid() )
@@ -757,8 +1026,18 @@ QList<Product> Project::allProducts(ProductFilter filter, bool onlyActives) cons
         break;
     }
 
-    walkAllProducts(d_imp->d_eng.data(),d_imp->d_eng->getRootModule(),ids, ef, onlyActives);
     QList<Product> res;
+    if( d_imp->d_snap.data() )
+    {
+        walkAllProducts(d_imp->d_snap.data(),0,ids,ef);
+        for( int i = 0; i < ids.size(); i++ )
+        {
+            if( !onlyActives || d_imp->d_snap->prods[ids[i]].active )
+                res << Internal::ProductImp::create(d_imp->d_snap.data(),ids[i]);
+        }
+        return res;
+    }
+    walkAllProducts(d_imp->d_eng.data(),d_imp->d_eng->getRootModule(),ids, ef, onlyActives);
     for( int i = 0; i < ids.size(); i++ )
         res << Product(d_imp->d_eng.data(),ids[i]);
     return res;
@@ -1032,7 +1311,7 @@ static void dumpOps( const Builder::OpList& ops )
 }
 
 BuildJob::BuildJob(QObject* owner, Engine* eng, const QProcessEnvironment& env,
-                   const QByteArrayList& targets, int count, bool stopOnErr, bool trackHdr)
+                   const QByteArrayList& targets, const BuildOptions& options)
     :AbstractJob(owner)
 {
     eng->createBuildDirs();
@@ -1044,7 +1323,14 @@ BuildJob::BuildJob(QObject* owner, Engine* eng, const QProcessEnvironment& env,
     dumpOps(ctx.ops);
 #endif
 
-    d_imp = new Imp(count, stopOnErr, trackHdr);
+    d_imp = new Imp(options.maxJobCount(), options.d_stopOnError, options.d_trackHeaders);
+    d_imp->setDependencyScheduling(options.d_depSched);
+    d_imp->setCompareContents(options.d_compareContents);
+    d_imp->setTrackCommands(options.d_trackCommands);
+    d_imp->setCompilerCache(options.d_cacheDir, options.d_cacheSize);
+    d_imp->setTimeout(options.d_timeout);
+    d_imp->setTrace(options.d_trace);
+    d_imp->setCompilerDeps(options.d_compilerDeps);
     d_imp->env = env;
     const int globals = eng->getGlobals();
     d_imp->workdir = eng->getPath(globals,"root_build_dir");
@@ -1056,8 +1342,10 @@ BuildJob::BuildJob(QObject* owner, Engine* eng, const QProcessEnvironment& env,
     connect(d_imp,SIGNAL(taskFinished(bool)),this,SIGNAL(taskFinished(bool)));
     connect(d_imp,SIGNAL(reportCommandDescription(const QString&, const QString&)),
             this,SIGNAL(reportCommandDescription(const QString&, const QString&)));
-    connect(d_imp,SIGNAL(reportResult( bool, const QStringList& )),
-            this,SLOT(reportResult( bool, const QStringList& )));
+    connect(d_imp,SIGNAL(reportResult( int, bool, const QStringList& )),
+            this,SLOT(reportResult( int, bool, const QStringList& )));
+    connect(d_imp,SIGNAL(reportOutput( int, const QStringList& )),
+            this,SLOT(reportOutput( int, const QStringList& )));
 }
 
 BuildJob::~BuildJob()
@@ -1075,11 +1363,23 @@ void BuildJob::cancel()
     QMetaObject::invokeMethod( d_imp, "onCancel" );
 }
 
-void BuildJob::reportResult( bool success, const QStringList& stdErr )
+void BuildJob::reportResult( int job, bool success, const QStringList& stdErr )
 {
     ProcessResult res;
     res.stdErr = stdErr;
     res.success = success;
+    res.job = job;
+    res.workingDirectory = d_imp->workdir;
+    qRegisterMetaType<ProcessResult>();
+    emit reportProcessResult(res);
+}
+
+void BuildJob::reportOutput( int job, const QStringList& stdErr )
+{
+    ProcessResult res;
+    res.stdErr = stdErr;
+    res.job = job;
+    res.finished = false;
     res.workingDirectory = d_imp->workdir;
     qRegisterMetaType<ProcessResult>();
     emit reportProcessResult(res);
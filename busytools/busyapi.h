@@ -21,6 +21,7 @@
 #include <QProcessEnvironment>
 #include <QAbstractItemModel>
 #include <QSet>
+#include <QFutureInterface>
 #include <projectexplorer/abi.h>
 
 namespace busy
@@ -33,6 +34,7 @@ namespace Internal
     class ModuleImp;
     class ProjectImp;
     class ProductImp;
+    class Snapshot;
 }
 
 class CodeLocation
@@ -79,7 +81,9 @@ public:
     QString workingDirectory;
     QStringList stdOut;
     QStringList stdErr;
-    ProcessResult():success(true){}
+    int job; // the results of concurrently running commands have different jobs
+    bool finished; // else only output of a command still running
+    ProcessResult():success(true),job(0),finished(true){}
 };
 
 class AbstractJob : public QObject
@@ -113,7 +117,9 @@ enum CommandEchoMode {
 class BuildOptions
 {
 public:
-    BuildOptions():d_maxJobs(0), d_stopOnError(true), d_trackHeaders(true) {}
+    BuildOptions():d_maxJobs(0), d_stopOnError(true), d_trackHeaders(true), d_depSched(false),
+        d_compareContents(false), d_trackCommands(true), d_trace(false), d_compilerDeps(false),
+        d_cacheSize(5 * 1024), d_timeout(240) {}
 
     void setFilesToConsider(const QStringList &files) {}
 
@@ -127,6 +133,14 @@ public:
 
     bool d_stopOnError;
     bool d_trackHeaders;
+    bool d_depSched;
+    bool d_compareContents;
+    bool d_trackCommands;
+    bool d_trace; // Chrome trace and summary of the slowest operations
+    bool d_compilerDeps; // track headers by compiler output instead of the code model; requires d_trackHeaders
+    QString d_cacheDir; // compiler cache, disabled if empty
+    int d_cacheSize; // MB
+    int d_timeout; // seconds per command, no timeout if zero
 
     CommandEchoMode echoMode() const { return CommandEchoModeSilent; }
     void setEchoMode(CommandEchoMode echoMode) {}
@@ -329,6 +343,8 @@ public:
     QString toolchain;
     QString version;
     ProjectExplorer::Abi abi;
+    int expectedModules; // evaluated by the previous parse, for the progress report
+    SetupProjectParameters():expectedModules(0){}
 };
 
 class Project
@@ -343,10 +359,19 @@ public:
     bool isValid() const;
     Engine* getEngine() const;
 
-    bool parse(const SetupProjectParameters &parameters, ILogSink *logSink);
+    // can run in a worker thread; progress is reported to and cancellation taken from the optional future
+    bool parse(const SetupProjectParameters &parameters, ILogSink *logSink,
+               QFutureInterface<bool>* progress = 0);
 
     ErrorInfo errors() const;
 
+    // the evaluated module and product tree can be saved to a file after a successful parse and
+    // loaded into an unparsed project to show it right away; such a project can not be built
+    // and is replaced when the real parse is done; key identifies the inputs of the parse
+    bool saveSnapshot(const QString& path, const QByteArray& key) const;
+    bool loadSnapshot(const QString& path, QByteArray& key);
+    bool isSnapshot() const;
+
     Module topModule() const;
     enum ProductFilter { AllProducts, RunnableProducts, CompiledProducts };
     QList<Product> allProducts(ProductFilter = AllProducts, bool onlyActives = false) const;
@@ -387,7 +412,7 @@ class BuildJob : public AbstractJob
     Q_OBJECT
 public:
     BuildJob(QObject* owner, Engine*, const QProcessEnvironment&, const QByteArrayList& targets,
-             int count, bool stopOnErr, bool trackHdr);
+             const BuildOptions&);
     ~BuildJob();
 
     void start();
@@ -398,7 +423,8 @@ signals:
     void reportProcessResult(const busy::ProcessResult&);
 
 protected slots:
-    void reportResult( bool success, const QStringList& stdErr );
+    void reportResult( int job, bool success, const QStringList& stdErr );
+    void reportOutput( int job, const QStringList& stdErr );
 
 private:
     class Imp;
@@ -22,13 +22,14 @@
 ****************************************************************************/
 
 #include "basefilefilter.h"
+#include "locatormatcher.h"
+#include "trigramindex.h"
 
 #include <core/editormanager/editormanager.h>
 #include <utils/fileutils.h>
 #include <utils/qtcassert.h>
 
 #include <QDir>
-#include <QStringMatcher>
 #include <QTimer>
 
 using namespace Core;
@@ -37,18 +38,31 @@ using namespace Utils;
 namespace Core {
 namespace Internal {
 
+class FileIndex
+{
+public:
+    FileIndex() : complete(false) {}
+
+    TrigramIndex trigrams; // of the paths, which include the names
+    QStringList paths;
+    QStringList names;
+    bool complete; // otherwise a canceled search indexed the first paths of the iterator
+};
+
 class Data
 {
 public:
     void clear()
     {
         iterator.clear();
+        index.clear();
         previousResultPaths.clear();
         previousResultNames.clear();
         previousEntry.clear();
     }
 
     QSharedPointer<BaseFileFilter::Iterator> iterator;
+    QSharedPointer<FileIndex> index; // built by the first selective new search
     QStringList previousResultPaths;
     QStringList previousResultNames;
     bool forceNewSearchList;
@@ -65,6 +79,14 @@ public:
 } // Internal
 } // Core
 
+// the index, even a partial one, is worth keeping for the next search
+static void keepIndexOnly(Internal::Data *data)
+{
+    const QSharedPointer<Internal::FileIndex> index = data->index;
+    data->clear();
+    data->index = index;
+}
+
 BaseFileFilter::Iterator::~Iterator()
 {}
 
@@ -84,6 +106,7 @@ void BaseFileFilter::prepareSearch(const QString &entry)
 {
     Q_UNUSED(entry)
     d->m_current.iterator = d->m_data.iterator;
+    d->m_current.index = d->m_data.index;
     d->m_current.previousResultPaths = d->m_data.previousResultPaths;
     d->m_current.previousResultNames = d->m_data.previousResultNames;
     d->m_current.forceNewSearchList = d->m_data.forceNewSearchList;
@@ -93,35 +116,65 @@ void BaseFileFilter::prepareSearch(const QString &entry)
 
 QList<LocatorFilterEntry> BaseFileFilter::matchesFor(QFutureInterface<LocatorFilterEntry> &future, const QString &origEntry)
 {
-    QList<LocatorFilterEntry> betterEntries;
-    QList<LocatorFilterEntry> goodEntries;
     QString needle = trimWildcards(QDir::fromNativeSeparators(origEntry));
     const QString lineNoSuffix = EditorManager::splitLineAndColumnNumber(&needle);
-    QStringMatcher matcher(needle, Qt::CaseInsensitive);
-    const QChar asterisk = QLatin1Char('*');
-    QRegExp regexp(asterisk + needle+ asterisk, Qt::CaseInsensitive, QRegExp::Wildcard);
-    if (!regexp.isValid()) {
+    const LocatorMatcher matcher(needle);
+    if (!matcher.isValid()) {
         d->m_current.clear(); // free memory
-        return betterEntries;
+        return QList<LocatorFilterEntry>();
     }
     const QChar pathSeparator(QLatin1Char('/'));
     const bool hasPathSeparator = needle.contains(pathSeparator);
-    const bool hasWildcard = needle.contains(asterisk) || needle.contains(QLatin1Char('?'));
+    // only then everything matching the needle also matched the previous entry by camel humps
     const bool containsPreviousEntry = !d->m_current.previousEntry.isEmpty()
-            && needle.contains(d->m_current.previousEntry);
+            && needle.startsWith(d->m_current.previousEntry);
     const bool pathSeparatorAdded = !d->m_current.previousEntry.contains(pathSeparator)
             && needle.contains(pathSeparator);
     const bool searchInPreviousResults = !d->m_current.forceNewSearchList && containsPreviousEntry
             && !pathSeparatorAdded;
-    if (searchInPreviousResults)
+    QTC_ASSERT(d->m_current.iterator.data(), return QList<LocatorFilterEntry>());
+    if (searchInPreviousResults) {
         d->m_current.iterator.reset(new ListIterator(d->m_current.previousResultPaths,
                                                      d->m_current.previousResultNames));
+    } else if (matcher.isSelective()) {
+        // an entry without three literal characters in a row would make every path a candidate
+        if (!d->m_current.index)
+            d->m_current.index.reset(new Internal::FileIndex);
+        Internal::FileIndex *index = d->m_current.index.data();
+        if (!index->complete) {
+            d->m_current.iterator->toFront();
+            for (int i = 0; i < index->paths.size() && d->m_current.iterator->hasNext(); ++i)
+                d->m_current.iterator->next(); // already indexed by a canceled search
+            while (d->m_current.iterator->hasNext()) {
+                if (future.isCanceled()) {
+                    keepIndexOnly(&d->m_current);
+                    QTimer::singleShot(0, this, SLOT(updateIndexData()));
+                    return QList<LocatorFilterEntry>();
+                }
+                d->m_current.iterator->next();
+                const QString path = d->m_current.iterator->filePath();
+                index->paths.append(path);
+                index->names.append(d->m_current.iterator->fileName());
+                index->trigrams.insert(QStringList() << path << LocatorMatcher::humps(path));
+            }
+            index->complete = true;
+        }
+        QVector<int> candidates;
+        if (matcher.candidates(index->trigrams, &candidates)) {
+            QStringList paths;
+            QStringList names;
+            foreach (int id, candidates) {
+                paths.append(index->paths.at(id));
+                names.append(index->names.at(id));
+            }
+            d->m_current.iterator.reset(new ListIterator(paths, names));
+        }
+    }
 
-    QTC_ASSERT(d->m_current.iterator.data(), return QList<LocatorFilterEntry>());
     d->m_current.previousResultPaths.clear();
     d->m_current.previousResultNames.clear();
     d->m_current.previousEntry = needle;
-    const Qt::CaseSensitivity caseSensitivityForPrefix = caseSensitivity(needle);
+    LocatorResults results;
     d->m_current.iterator->toFront();
     bool canceled = false;
     while (d->m_current.iterator->hasNext()) {
@@ -134,32 +187,31 @@ QList<LocatorFilterEntry> BaseFileFilter::matchesFor(QFutureInterface<LocatorFil
         QString path = d->m_current.iterator->filePath();
         QString name = d->m_current.iterator->fileName();
         QString matchText = hasPathSeparator ? path : name;
-        if ((hasWildcard && regexp.exactMatch(matchText))
-                || (!hasWildcard && matcher.indexIn(matchText) != -1)) {
-            QFileInfo fi(path);
-            LocatorFilterEntry entry(this, fi.fileName(), QString(path + lineNoSuffix));
-            entry.extraInfo = FileUtils::shortNativePath(FileName(fi));
-            entry.fileName = path;
-            if (matchText.startsWith(needle, caseSensitivityForPrefix))
-                betterEntries.append(entry);
-            else
-                goodEntries.append(entry);
+        const int score = matcher.score(matchText);
+        if (score != LocatorMatcher::NoMatch) {
+            if (results.accepts(score)) {
+                QFileInfo fi(path);
+                LocatorFilterEntry entry(this, fi.fileName(), QString(path + lineNoSuffix));
+                entry.extraInfo = FileUtils::shortNativePath(FileName(fi));
+                entry.fileName = path;
+                results.add(score, entry);
+            }
             d->m_current.previousResultPaths.append(path);
             d->m_current.previousResultNames.append(name);
         }
     }
 
-    betterEntries.append(goodEntries);
     if (canceled) {
         // we keep the old list of previous search results if this search was canceled
         // so a later search without foreNewSearchList will use that previous list instead of an
         // incomplete list of a canceled search
-        d->m_current.clear(); // free memory
+        keepIndexOnly(&d->m_current); // free memory
+        QTimer::singleShot(0, this, SLOT(updateIndexData()));
     } else {
         d->m_current.iterator.clear();
         QTimer::singleShot(0, this, SLOT(updatePreviousResultData()));
     }
-    return betterEntries;
+    return results.entries();
 }
 
 void BaseFileFilter::accept(LocatorFilterEntry selection) const
@@ -192,9 +244,18 @@ void BaseFileFilter::updatePreviousResultData()
     d->m_data.previousEntry = d->m_current.previousEntry;
     d->m_data.previousResultPaths = d->m_current.previousResultPaths;
     d->m_data.previousResultNames = d->m_current.previousResultNames;
+    updateIndexData();
     // forceNewSearchList was already reset in prepareSearch
 }
 
+void BaseFileFilter::updateIndexData()
+{
+    if (d->m_data.forceNewSearchList) // the index is of the previous iterator
+        return;
+    if (!d->m_data.index)
+        d->m_data.index = d->m_current.index;
+}
+
 BaseFileFilter::ListIterator::ListIterator(const QStringList &filePaths)
 {
     m_filePaths = filePaths;
@@ -85,6 +85,7 @@ protected:
 
 private slots:
     void updatePreviousResultData();
+    void updateIndexData();
 
 private:
     Internal::BaseFileFilterPrivate *d;
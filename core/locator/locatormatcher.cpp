@@ -0,0 +1,220 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "locatormatcher.h"
+#include "trigramindex.h"
+
+#include <algorithm>
+
+using namespace Core;
+
+// Each kind of match outranks the next one; within a kind shorter texts come first
+enum {
+    ExactMatch = 700,
+    PrefixMatch = 600,
+    CaseInsensitivePrefixMatch = 500,
+    HumpSubstringMatch = 400, // starting at a hump
+    SubstringMatch = 300,
+    HumpMatch = 200,
+    WildcardMatch = 200,
+    MaxLengthPenalty = 99
+};
+
+static inline bool isSeparator(QChar c)
+{
+    return !c.isLetterOrNumber();
+}
+
+static bool isHumpStart(const QString &text, int pos)
+{
+    const QChar c = text.at(pos);
+    if (isSeparator(c))
+        return false;
+    if (pos == 0)
+        return true;
+    const QChar prev = text.at(pos - 1);
+    if (isSeparator(prev))
+        return true;
+    if (c.isUpper()) // "FooBar", or "S" in "HTTPServer"
+        return !prev.isUpper() || (pos + 1 < text.size() && text.at(pos + 1).isLower());
+    if (c.isDigit())
+        return !prev.isDigit();
+    return false;
+}
+
+LocatorMatcher::LocatorMatcher(const QString &entry)
+    : m_entry(entry)
+    , m_prefixCaseSensitivity(ILocatorFilter::caseSensitivity(entry))
+    , m_hasWildcard(entry.contains(QLatin1Char('*')) || entry.contains(QLatin1Char('?')))
+    , m_matcher(entry, Qt::CaseInsensitive)
+    , m_regexp(QLatin1Char('*') + entry + QLatin1Char('*'), Qt::CaseInsensitive, QRegExp::Wildcard)
+{
+    if (m_hasWildcard)
+        return;
+    // The humps of the entry start at upper case letters and after separators
+    QString hump;
+    foreach (const QChar &c, entry) {
+        if (isSeparator(c) || c.isUpper()) {
+            if (!hump.isEmpty())
+                m_humps.append(hump);
+            hump.clear();
+        }
+        if (!isSeparator(c))
+            hump.append(c);
+    }
+    if (!hump.isEmpty())
+        m_humps.append(hump);
+}
+
+int LocatorMatcher::score(const QString &text) const
+{
+    const int penalty = qMin(text.size(), int(MaxLengthPenalty));
+    if (m_hasWildcard)
+        return m_regexp.exactMatch(text) ? WildcardMatch - penalty : NoMatch;
+
+    const int pos = m_matcher.indexIn(text);
+    if (pos == 0) {
+        if (text.size() == m_entry.size())
+            return ExactMatch;
+        if (text.startsWith(m_entry, m_prefixCaseSensitivity))
+            return PrefixMatch - penalty;
+        return CaseInsensitivePrefixMatch - penalty;
+    }
+    if (pos > 0)
+        return (isHumpStart(text, pos) ? HumpSubstringMatch : SubstringMatch) - penalty;
+    return matchesHumps(text) ? HumpMatch - penalty : NoMatch;
+}
+
+bool LocatorMatcher::matchesHumps(const QString &text) const
+{
+    if (m_humps.size() < 2)
+        return false; // a single hump only matches as substring
+
+    QVector<int> starts;
+    for (int pos = 0; pos < text.size(); ++pos) {
+        if (isHumpStart(text, pos))
+            starts.append(pos);
+    }
+    starts.append(text.size());
+
+    for (int first = 0; first + m_humps.size() < starts.size(); ++first) {
+        int i = 0;
+        for (; i < m_humps.size(); ++i) {
+            const QString &hump = m_humps.at(i);
+            const int start = starts.at(first + i);
+            if (start + hump.size() > starts.at(first + i + 1)
+                    || text.midRef(start, hump.size()).compare(hump, Qt::CaseInsensitive) != 0) {
+                break;
+            }
+        }
+        if (i == m_humps.size())
+            return true;
+    }
+    return false;
+}
+
+bool LocatorMatcher::candidates(const TrigramIndex &index, QVector<int> *ids) const
+{
+    if (m_humps.size() < 2)
+        return index.candidates(m_entry, ids);
+
+    // A text matching as substring also contains each hump of the entry
+    const QString humpPattern = m_humps.join(QLatin1Char('*'));
+    if (TrigramIndex::isSelective(humpPattern))
+        return index.candidates(humpPattern, ids);
+
+    // Otherwise consecutive humps of the text start with the humps of the entry
+    QString initials;
+    foreach (const QString &hump, m_humps)
+        initials.append(hump.at(0).toLower());
+    QVector<int> humpIds;
+    if (!index.candidates(m_entry, ids) || !index.candidates(initials, &humpIds))
+        return false;
+    QVector<int> merged;
+    std::set_union(ids->constBegin(), ids->constEnd(), humpIds.constBegin(), humpIds.constEnd(),
+                   std::back_inserter(merged));
+    ids->swap(merged);
+    return true;
+}
+
+bool LocatorMatcher::isSelective() const
+{
+    if (m_humps.size() < 2)
+        return TrigramIndex::isSelective(m_entry);
+    if (TrigramIndex::isSelective(m_humps.join(QLatin1Char('*'))))
+        return true;
+    // see candidates(); the initials are as many characters as there are humps
+    return m_humps.size() >= 3 && TrigramIndex::isSelective(m_entry);
+}
+
+QString LocatorMatcher::humps(const QString &text)
+{
+    QString result;
+    for (int pos = 0; pos < text.size(); ++pos) {
+        if (isHumpStart(text, pos))
+            result.append(text.at(pos).toLower());
+    }
+    return result;
+}
+
+LocatorResults::LocatorResults(int maxResults)
+    : m_maxResults(maxResults)
+{
+}
+
+bool LocatorResults::accepts(int score) const
+{
+    return m_heap.size() < m_maxResults || score >= m_heap.first().score;
+}
+
+void LocatorResults::add(int score, const LocatorFilterEntry &entry)
+{
+    const Result result = { score, entry };
+    if (m_heap.size() < m_maxResults) {
+        m_heap.append(result);
+        std::push_heap(m_heap.begin(), m_heap.end(), isBetter);
+    } else if (isBetter(result, m_heap.first())) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), isBetter);
+        m_heap.last() = result;
+        std::push_heap(m_heap.begin(), m_heap.end(), isBetter);
+    }
+}
+
+void LocatorResults::add(const LocatorResults &other)
+{
+    foreach (const Result &result, other.m_heap) {
+        if (accepts(result.score))
+            add(result.score, result.entry);
+    }
+}
+
+QList<LocatorFilterEntry> LocatorResults::entries() const
+{
+    QVector<Result> results = m_heap;
+    std::sort(results.begin(), results.end(), isBetter);
+    QList<LocatorFilterEntry> entries;
+    entries.reserve(results.size());
+    foreach (const Result &result, results)
+        entries.append(result.entry);
+    return entries;
+}
+
+bool LocatorResults::isBetter(const Result &lhs, const Result &rhs)
+{
+    if (lhs.score != rhs.score)
+        return lhs.score > rhs.score;
+    return lhs.entry.displayName < rhs.entry.displayName;
+}
@@ -0,0 +1,90 @@
+#ifndef LOCATORMATCHER_H
+#define LOCATORMATCHER_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "ilocatorfilter.h"
+
+#include <QRegExp>
+#include <QStringMatcher>
+#include <QVector>
+
+namespace Core {
+
+class TrigramIndex;
+
+// Matches the entry typed into the locator as substring or wildcard pattern, or by camel humps,
+// so "CLF" or "cppLocF" match "CppLocatorFilter" and "co/lo/ba" matches
+// "core/locator/basefilefilter.cpp"; the humps of the entry have to match consecutive humps of
+// the text. A higher score is a better match.
+class CORE_EXPORT LocatorMatcher
+{
+public:
+    enum { NoMatch = -1 };
+
+    explicit LocatorMatcher(const QString &entry); // with the wildcards already trimmed
+
+    bool isValid() const { return m_regexp.isValid(); }
+    int score(const QString &text) const;
+
+    // The index has to contain the texts and their humps(); returns false if every entry of the
+    // index is a candidate.
+    bool candidates(const TrigramIndex &index, QVector<int> *ids) const;
+    bool isSelective() const; // false if candidates() cannot narrow down any index
+    static QString humps(const QString &text); // the lower case first letters of the humps
+
+private:
+    bool matchesHumps(const QString &text) const;
+
+    QString m_entry;
+    Qt::CaseSensitivity m_prefixCaseSensitivity;
+    bool m_hasWildcard;
+    QStringMatcher m_matcher;
+    QRegExp m_regexp;
+    QStringList m_humps;
+};
+
+// Keeps the best entries found by a filter, ordered by score and then by display name, so huge
+// result lists are neither built nor sorted.
+class CORE_EXPORT LocatorResults
+{
+public:
+    enum { MaxResults = 500 };
+
+    explicit LocatorResults(int maxResults = MaxResults);
+
+    // Whether an entry with the score could be kept; saves creating entries which are dropped
+    bool accepts(int score) const;
+    void add(int score, const LocatorFilterEntry &entry);
+    void add(const LocatorResults &other); // e.g. of a search running in parallel
+    QList<LocatorFilterEntry> entries() const; // best first
+
+private:
+    struct Result
+    {
+        int score;
+        LocatorFilterEntry entry;
+    };
+    static bool isBetter(const Result &lhs, const Result &rhs);
+
+    QVector<Result> m_heap; // the worst kept result on top
+    int m_maxResults;
+};
+
+} // namespace Core
+
+#endif // LOCATORMATCHER_H
@@ -0,0 +1,139 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "trigramindex.h"
+
+#include <QRegExp>
+
+#include <algorithm>
+
+using namespace Core;
+
+static QStringList literals(const QString &pattern)
+{
+    // Character sets of QRegExp::Wildcard patterns are not looked into
+    if (pattern.contains(QLatin1Char('[')))
+        return QStringList();
+    return pattern.split(QRegExp(QLatin1String("[*?]")), QString::SkipEmptyParts);
+}
+
+static void addTrigrams(const QString &text, QSet<quint64> *trigrams)
+{
+    const QString lower = text.toLower();
+    const QChar *p = lower.constData();
+    for (int i = 0, n = lower.size() - 2; i < n; ++i) {
+        trigrams->insert(quint64(p[i].unicode()) << 32 | quint64(p[i + 1].unicode()) << 16
+                         | p[i + 2].unicode());
+    }
+}
+
+TrigramIndex::TrigramIndex()
+    : m_nextId(0)
+    , m_count(0)
+{
+}
+
+int TrigramIndex::insert(const QStringList &texts)
+{
+    QSet<quint64> trigrams;
+    foreach (const QString &text, texts)
+        addTrigrams(text, &trigrams);
+    const int id = m_nextId++;
+    foreach (quint64 trigram, trigrams)
+        m_postings[trigram].append(id);
+    ++m_count;
+    return id;
+}
+
+void TrigramIndex::remove(int id)
+{
+    if (id < 0 || id >= m_nextId || m_removed.contains(id))
+        return;
+    m_removed.insert(id);
+    --m_count;
+    // Removed ids are only filtered out of the postings once they are a considerable part
+    if (m_removed.size() > 1000 && m_removed.size() > m_count)
+        compact();
+}
+
+void TrigramIndex::clear()
+{
+    m_postings.clear();
+    m_removed.clear();
+    m_nextId = 0;
+    m_count = 0;
+}
+
+bool TrigramIndex::candidates(const QString &pattern, QVector<int> *ids) const
+{
+    QSet<quint64> trigrams;
+    foreach (const QString &literal, literals(pattern))
+        addTrigrams(literal, &trigrams);
+    if (trigrams.isEmpty())
+        return false;
+
+    QList<const QVector<int> *> postings;
+    foreach (quint64 trigram, trigrams) {
+        QHash<quint64, QVector<int> >::const_iterator it = m_postings.constFind(trigram);
+        if (it == m_postings.constEnd()) {
+            ids->clear();
+            return true;
+        }
+        postings.append(&it.value());
+    }
+    std::sort(postings.begin(), postings.end(),
+              [](const QVector<int> *a, const QVector<int> *b) { return a->size() < b->size(); });
+
+    ids->clear();
+    foreach (int id, *postings.first()) {
+        if (!m_removed.contains(id))
+            ids->append(id);
+    }
+    for (int i = 1; i < postings.size() && !ids->isEmpty(); ++i) {
+        const QVector<int> &posting = *postings.at(i);
+        QVector<int> common;
+        std::set_intersection(ids->constBegin(), ids->constEnd(),
+                              posting.constBegin(), posting.constEnd(),
+                              std::back_inserter(common));
+        ids->swap(common);
+    }
+    return true;
+}
+
+bool TrigramIndex::isSelective(const QString &pattern)
+{
+    foreach (const QString &literal, literals(pattern)) {
+        if (literal.size() >= 3)
+            return true;
+    }
+    return false;
+}
+
+void TrigramIndex::compact()
+{
+    QHash<quint64, QVector<int> >::iterator it = m_postings.begin();
+    while (it != m_postings.end()) {
+        QVector<int> &posting = it.value();
+        posting.erase(std::remove_if(posting.begin(), posting.end(),
+                                     [this](int id) { return m_removed.contains(id); }),
+                      posting.end());
+        if (posting.isEmpty())
+            it = m_postings.erase(it);
+        else
+            ++it;
+    }
+    m_removed.clear();
+}
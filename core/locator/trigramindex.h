@@ -0,0 +1,60 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <core/core_global.h>
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+namespace Core {
+
+// Maps the case insensitive trigrams of the texts of an entry to the entry, so a substring or
+// wildcard search only has to look at the candidate entries instead of at all of them.
+// Not thread-safe.
+class CORE_EXPORT TrigramIndex
+{
+public:
+    TrigramIndex();
+
+    int insert(const QStringList &texts); // returns the id of the new entry, ascending
+    void remove(int id);
+    void clear();
+    int size() const { return m_count; }
+
+    // The ids of the entries with a text which might contain pattern, possibly with * and ?
+    // wildcards. Returns false if the pattern is not selective, in which case every entry is a
+    // candidate.
+    bool candidates(const QString &pattern, QVector<int> *ids) const;
+    // True if the pattern has a literal part of at least three characters
+    static bool isSelective(const QString &pattern);
+
+private:
+    void compact();
+
+    QHash<quint64, QVector<int> > m_postings; // ascending ids, including removed ones
+    QSet<int> m_removed;
+    int m_nextId;
+    int m_count;
+};
+
+} // namespace Core
+
+#endif // TRIGRAMINDEX_H
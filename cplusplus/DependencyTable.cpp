@@ -32,8 +32,16 @@
 
 #include <QDebug>
 
+#include <algorithm>
+
 using namespace CPlusPlus;
 
+bool DependencyTable::dependsOn(int file, int included) const
+{
+    const QVector<int> &closure = components.at(component.at(file)).closure;
+    return std::binary_search(closure.begin(), closure.end(), included);
+}
+
 Utils::FileNameList DependencyTable::filesDependingOn(const Utils::FileName &fileName) const
 {
     Utils::FileNameList deps;
@@ -42,10 +50,8 @@ Utils::FileNameList DependencyTable::filesDependingOn(const Utils::FileName &fil
     if (index == -1)
         return deps;
 
-    for (int i = 0; i < files.size(); ++i) {
-        const QBitArray &bits = includeMap.at(i);
-
-        if (bits.testBit(index))
+    for (int i = 0; i < component.size(); ++i) {
+        if (files.at(i).present && dependsOn(i, index))
             deps.append(files.at(i).name);
     }
 
@@ -54,110 +60,272 @@ Utils::FileNameList DependencyTable::filesDependingOn(const Utils::FileName &fil
 
 Utils::FileNameList DependencyTable::allFilesDependingOnModifieds() const
 {
-    QSet<int> tmp;
-    for( int j = 0; j < files.size(); j++ )
+    Utils::FileNameList res;
+    for( int i = 0; i < component.size(); ++i )
     {
-        // i includes/depends on j
-        for( int i = 0; i < files.size(); ++i ) {
-            const QBitArray &bits = includeMap.at(i);
-
-            if( bits.testBit(j) && files[j].modified > files[i].modified )
-                tmp.insert(i);
-        }
+        // i includes/depends on a file newer than itself
+        if( files[i].present && components.at(component.at(i)).newest > files[i].modified )
+            res.append(files[i].name);
     }
-    Utils::FileNameList res;
-    for( QSet<int>::const_iterator i = tmp.begin(); i != tmp.end(); ++i )
-        res.append(files[*i].name);
     return res;
 }
 
 bool DependencyTable::anyNewerDeps(const QString& path, uint ref, QString* reason) const
 {
     int index = fileIndex.value(Utils::FileName::fromString(path), -1);
-    if(index == -1 || index >= includeMap.size() )
+    if(index == -1 || index >= component.size() )
         return false;
 
-#if 0
-    QList<int> toCheck = includes.value(index);
-    for( int i = 0; i < toCheck.size(); i++ )
-    {
-        const File& f = files[toCheck[i]];
-        if( f.modified > ref )
-            return true;
-    }
-#else
-    const QBitArray &bits = includeMap.at(index);
-    for( int j = 0; j < files.size(); j++ )
+    const Component& c = components.at(component.at(index));
+    if( c.newestFile != -1 && c.newest > ref )
     {
-        if( j < bits.size() && bits.testBit(j) && files[j].modified > ref )
-        {
-            if( reason )
-                *reason = files[j].name.toString();
-            return true;
-        }
+        if( reason )
+            *reason = files[c.newestFile].name.toString();
+        return true;
     }
-#endif
     return false;
 }
 
+QStringList DependencyTable::includedFiles(const QString& path) const
+{
+    QStringList res;
+    int index = fileIndex.value(Utils::FileName::fromString(path), -1);
+    if(index == -1 || index >= component.size() )
+        return res;
+
+    foreach( int j, components.at(component.at(index)).closure )
+        res.append(files[j].name.toString());
+    res.sort();
+    return res;
+}
+
 void DependencyTable::build(const Snapshot &snapshot)
 {
     files.clear();
     fileIndex.clear();
     includes.clear();
-    includeMap.clear();
+    component.clear();
+    components.clear();
+    staleFiles.clear();
+
+    for (Snapshot::const_iterator it = snapshot.begin(); it != snapshot.end(); ++it)
+        indexOf(it.key());
 
-    const int documentCount = snapshot.size();
-    files.resize(documentCount);
-    includeMap.resize(documentCount);
+    for (Snapshot::const_iterator it = snapshot.begin(); it != snapshot.end(); ++it)
+        insert(it.key(), it.value()->includedFiles());
+
+    updateClosures();
+}
 
-    int i = 0;
-    for (Snapshot::const_iterator it = snapshot.begin(); it != snapshot.end();
-            ++it, ++i) {
-        files[i] = File(it.key(),QFileInfo(it.key().toString()).lastModified().toTime_t());
-        fileIndex[it.key()] = i;
+int DependencyTable::indexOf(const Utils::FileName &fileName)
+{
+    int index = fileIndex.value(fileName, -1);
+    if (index == -1) {
+        index = files.size();
+        files.append(File(fileName));
+        files.last().present = false;
+        includes.append(QVector<int>());
+        fileIndex.insert(fileName, index);
+        markStale(index);
     }
+    return index;
+}
 
-    for (int i = 0; i < files.size(); ++i) {
-        const File &file = files.at(i);
-        if (Document::Ptr doc = snapshot.document(file.name)) {
-            QBitArray bitmap(files.size());
-            QList<int> directIncludes;
-            const QStringList documentIncludes = doc->includedFiles();
+void DependencyTable::markStale(int file)
+{
+    if (!files.at(file).stale) {
+        files[file].stale = true;
+        staleFiles.append(file);
+    }
+}
 
-            foreach (const QString &includedFile, documentIncludes) {
-                int index = fileIndex.value(Utils::FileName::fromString(includedFile));
+void DependencyTable::insert(const Utils::FileName &fileName, const QStringList &includedFiles)
+{
+    const int i = indexOf(fileName);
+    markStale(i); // also when the file comes back after remove()
+    files[i].present = true;
 
-                if (index == -1)
-                    continue;
-                else if (! directIncludes.contains(index))
-                    directIncludes.append(index);
+    QVector<int> directIncludes;
+    foreach (const QString &includedFile, includedFiles) {
+        const int index = indexOf(Utils::FileName::fromString(includedFile));
+        if (! directIncludes.contains(index))
+            directIncludes.append(index);
+    }
+    if (directIncludes != includes.at(i)) {
+        includes[i] = directIncludes;
+        dirty = true;
+    }
+}
 
-                bitmap.setBit(index, true);
-            }
+void DependencyTable::remove(const Utils::FileName &fileName)
+{
+    // the index is kept, so the file can come back and the closures of others stay valid
+    const int i = fileIndex.value(fileName, -1);
+    if (i == -1 || !files.at(i).present)
+        return;
+    files[i].present = false;
+    if (!includes.at(i).isEmpty()) {
+        includes[i].clear();
+        dirty = true;
+    }
+}
 
-            includeMap[i] = bitmap;
-            includes[i] = directIncludes;
-        }
+void DependencyTable::updateClosures()
+{
+    const bool restat = !staleFiles.isEmpty();
+    foreach (int i, staleFiles) {
+        files[i].modified = QFileInfo(files.at(i).name.toString()).lastModified().toTime_t();
+        files[i].stale = false;
     }
+    staleFiles.clear();
 
-    bool changed;
+    if (dirty || component.size() != files.size()) {
+        component.clear();
+        components.clear();
+        buildClosures();
+        dirty = false;
+    } else if (restat) {
+        for (int c = 0; c < components.size(); ++c)
+            updateNewest(components[c]);
+    }
+}
 
-    do {
-        changed = false;
+void DependencyTable::refreshModified()
+{
+    for (int i = 0; i < files.size(); ++i) {
+        files[i].modified = QFileInfo(files.at(i).name.toString()).lastModified().toTime_t();
+        files[i].stale = false;
+    }
+    staleFiles.clear();
+    for (int c = 0; c < components.size(); ++c)
+        updateNewest(components[c]);
+}
+
+void DependencyTable::updateNewest(Component &comp) const
+{
+    comp.newest = 0;
+    comp.newestFile = -1;
+    foreach (int x, comp.closure) {
+        if (comp.newestFile == -1 || files.at(x).modified > comp.newest) {
+            comp.newest = files.at(x).modified;
+            comp.newestFile = x;
+        }
+    }
+}
 
-        for (int i = 0; i < files.size(); ++i) {
-            QBitArray bitmap = includeMap.value(i);
-            QBitArray previousBitmap = bitmap;
+void DependencyTable::buildClosures()
+{
+    // Tarjan's algorithm without recursion; a component is completed after all components its
+    // members include, so their closures are known when its own is merged
+    const int n = files.size();
+    QVector<int> order(n, -1);
+    QVector<int> low(n, 0);
+    QVector<bool> onStack(n, false);
+    QVector<int> stack;
+    QVector<QPair<int, int> > calls; // file, position in its includes
+    QVector<int> members;
+    QVector<int> seen(n, -1); // component which last added the file to its closure
+    QVector<int> merged(n, -1); // component which last merged the closure of the component
+    QMultiHash<uint, int> closures; // hash of a closure -> first component with it
+    int counter = 0;
 
-            foreach (int includedFileIndex, includes.value(i)) {
-                bitmap |= includeMap.value(includedFileIndex);
+    component.fill(-1, n);
+    for (int root = 0; root < n; ++root) {
+        if (order[root] != -1)
+            continue;
+        order[root] = low[root] = counter++;
+        stack.append(root);
+        onStack[root] = true;
+        calls.append(qMakePair(root, 0));
+        while (!calls.isEmpty()) {
+            const int v = calls.last().first;
+            const QVector<int> &succs = includes.at(v);
+            if (calls.last().second < succs.size()) {
+                const int w = succs.at(calls.last().second++);
+                if (order[w] == -1) {
+                    order[w] = low[w] = counter++;
+                    stack.append(w);
+                    onStack[w] = true;
+                    calls.append(qMakePair(w, 0));
+                } else if (onStack[w]) {
+                    low[v] = qMin(low[v], order[w]);
+                }
+                continue;
             }
+            calls.removeLast();
+            if (!calls.isEmpty()) {
+                const int caller = calls.last().first;
+                low[caller] = qMin(low[caller], low[v]);
+            }
+            if (low[v] == order[v]) {
+                members.clear();
+                int w;
+                do {
+                    w = stack.takeLast();
+                    onStack[w] = false;
+                    component[w] = components.size();
+                    members.append(w);
+                } while (w != v);
+                mergeClosure(members, seen, merged, closures);
+            }
+        }
+    }
+}
+
+void DependencyTable::mergeClosure(const QVector<int> &members, QVector<int> &seen,
+                                   QVector<int> &merged, QMultiHash<uint, int> &closures)
+{
+    const int c = components.size();
+    Component comp;
+    bool cyclic = members.size() > 1;
 
-            if (bitmap != previousBitmap) {
-                includeMap[i] = bitmap;
-                changed = true;
+    foreach (int m, members) {
+        foreach (int w, includes.at(m)) {
+            const int d = component.at(w);
+            if (d == c) {
+                cyclic = true; // includes itself or another member
+                continue;
+            }
+            if (seen[w] != c) {
+                seen[w] = c;
+                comp.closure.append(w);
+            }
+            if (merged[d] == c)
+                continue;
+            merged[d] = c;
+            foreach (int x, components.at(d).closure) {
+                if (seen[x] != c) {
+                    seen[x] = c;
+                    comp.closure.append(x);
+                }
+            }
+        }
+    }
+    if (cyclic) {
+        foreach (int m, members) {
+            if (seen[m] != c) {
+                seen[m] = c;
+                comp.closure.append(m);
             }
         }
-    } while (changed);
+    }
+    std::sort(comp.closure.begin(), comp.closure.end());
+
+    // Files including the same set of headers are common, so equal closures are stored once
+    uint hash = 0;
+    foreach (int x, comp.closure)
+        hash = hash * 31 + uint(x);
+    QMultiHash<uint, int>::const_iterator it = closures.constFind(hash);
+    for (; it != closures.constEnd() && it.key() == hash; ++it) {
+        if (components.at(it.value()).closure == comp.closure)
+            break;
+    }
+    if (it != closures.constEnd() && it.key() == hash) {
+        comp.closure = components.at(it.value()).closure;
+    } else {
+        comp.closure.squeeze();
+        closures.insert(hash, c);
+    }
+    updateNewest(comp);
+    components.append(comp);
 }
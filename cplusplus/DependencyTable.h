@@ -35,7 +35,6 @@
 
 #include <utils/fileutils.h>
 
-#include <QBitArray>
 #include <QHash>
 #include <QString>
 #include <QStringList>
@@ -51,21 +50,53 @@ private:
     struct File {
         Utils::FileName name;
         uint modified;
-        File(const Utils::FileName& _name = Utils::FileName(), uint _mod = 0):name(_name),modified(_mod){}
+        bool present; // a document of the file was inserted, not only included by one
+        bool stale; // modified is read from the disk by updateClosures
+        File(const Utils::FileName& _name = Utils::FileName(), uint _mod = 0):name(_name),modified(_mod),present(true),stale(false){}
+    };
+
+    // a strongly connected component of the include graph; all its files share the closure
+    struct Component {
+        QVector<int> closure; // sorted indices of all files transitively included by the members;
+                              // shared by the components with the same closure
+        uint newest; // latest modification time in closure
+        int newestFile; // index in files or -1 if closure is empty
+        Component():newest(0),newestFile(-1){}
     };
 
     friend class Snapshot;
     void build(const Snapshot &snapshot);
+    int indexOf(const Utils::FileName &fileName);
+    void markStale(int file);
+    void buildClosures();
+    void updateNewest(Component &comp) const;
+    void mergeClosure(const QVector<int> &members, QVector<int> &seen, QVector<int> &merged,
+                      QMultiHash<uint, int> &closures);
+    bool dependsOn(int file, int included) const;
 
     QVector<File> files;
     QHash<Utils::FileName, int> fileIndex;
-    QHash<int, QList<int> > includes;
-    QVector<QBitArray> includeMap;
+    QVector<QVector<int> > includes; // direct, by file index
+    QVector<int> component; // file index -> index in components
+    QVector<Component> components; // in reverse topological order
+    QVector<int> staleFiles;
+    bool dirty; // includes changed since the closures were computed
 
 public:
+    DependencyTable():dirty(false){}
+
+    // maintained document by document, e.g. by the model manager, instead of built from a snapshot;
+    // queries reflect the changes only after updateClosures(), which is also the only one to
+    // stat the inserted files, so insert and remove are cheap enough to be called under a lock
+    void insert(const Utils::FileName &fileName, const QStringList &includedFiles);
+    void remove(const Utils::FileName &fileName);
+    void updateClosures();
+    void refreshModified(); // stat all files again
+
     Utils::FileNameList filesDependingOn(const Utils::FileName &fileName) const;
     Utils::FileNameList allFilesDependingOnModifieds() const;
     bool anyNewerDeps(const QString& path, uint ref, QString* reason = 0) const;
+    QStringList includedFiles(const QString& path) const; // transitively, sorted
 };
 
 } // namespace CPlusPlus
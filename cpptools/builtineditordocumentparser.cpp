@@ -172,6 +172,8 @@ void BuiltinEditorDocumentParser::updateHelper(const InMemoryInfo &info)
         Snapshot globalSnapshot = modelManager->snapshot();
         globalSnapshot.remove(filePath());
         sourceProcessor.setGlobalSnapshot(globalSnapshot);
+        sourceProcessor.setHeaderCache(modelManager->headerCache());
+        sourceProcessor.setIncludeDirCache(modelManager->includeDirCache());
         sourceProcessor.setWorkingCopy(workingCopy);
         sourceProcessor.setHeaderPaths(state.headerPaths);
         sourceProcessor.setLanguageFeatures(features);
@@ -32,6 +32,7 @@
 #include "cpptoolsplugin.h"
 #include "searchsymbols.h"
 
+#include <core/editormanager/editormanager.h>
 #include <core/icore.h>
 #include <core/find/searchresultwindow.h>
 #include <core/progressmanager/progressmanager.h>
@@ -39,15 +40,21 @@
 #include <cplusplus/LookupContext.h>
 #include <utils/qtcassert.h>
 #include <utils/runextensions.h>
+#include <utils/textfileformat.h>
 
 #include <QCoreApplication>
 #include <QDir>
 #include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
 
 using namespace CppTools;
 using namespace CppTools::Internal;
 
 static const bool FindErrorsIndexing = qgetenv("QTC_FIND_ERRORS_INDEXING") == "1";
+static const bool BenchmarkIndexing = qgetenv("QTC_BENCHMARK_INDEXING") == "1";
 
 namespace {
 
@@ -174,23 +181,130 @@ static void indexFindErrors(QFutureInterface<void> &future, const ParseParams pa
     qDebug("FindErrorsIndexing: Finished after %s.", qPrintable(time));
 }
 
-static void index(QFutureInterface<void> &future, const ParseParams params)
+// peak resident set size in KiB, or -1 if unknown on this platform
+static qint64 peakMemory()
 {
-    QScopedPointer<CppSourceProcessor> sourceProcessor(CppModelManager::createSourceProcessor());
-    sourceProcessor->setHeaderPaths(params.headerPaths);
-    sourceProcessor->setWorkingCopy(params.workingCopy);
+    QFile status(QLatin1String("/proc/self/status"));
+    if (status.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray &line, status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).simplified().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
 
-    QStringList sources;
-    QStringList headers;
+static double seconds(qint64 nsecs)
+{
+    return nsecs / 1e9;
+}
+
+// Indexes the files in a single thread without the header cache, so every file is preprocessed,
+// and then times the phases of each project file again separately. The numbers of two runs over
+// the same project are comparable.
+static void indexBenchmark(QFutureInterface<void> &future, const ParseParams params)
+{
+    QStringList sources, headers;
     classifyFiles(params.sourceFiles, &headers, &sources);
+    sources.sort();
+    headers.sort();
+    const QStringList files = sources + headers;
 
+    QScopedPointer<CppSourceProcessor> sourceProcessor(CppModelManager::createSourceProcessor());
+    sourceProcessor->setHeaderCache(0);
+    sourceProcessor->setWorkingCopy(params.workingCopy);
     foreach (const QString &file, params.sourceFiles)
         sourceProcessor->removeFromCache(file);
 
-    const int sourceCount = sources.size();
-    QStringList files = sources + headers;
+    CppModelManager *cmm = CppModelManager::instance();
+    const QString conf = CppModelManager::configurationFileName();
+    qint64 bytes = 0;
+    qint64 indexTime = 0, preprocessTime = 0, lexTime = 0, parseTime = 0, bindTime = 0;
+    qint64 lookupTime = 0;
+    QElapsedTimer timer;
+    int i = 0;
+    for (const int end = files.size(); i < end; ++i) {
+        if (future.isPaused())
+            future.waitForResume();
+        if (future.isCanceled())
+            break;
 
-    sourceProcessor->setTodo(files.toSet());
+        const QString fileName = files.at(i);
+        const QList<ProjectPart::Ptr> parts = cmm->projectPart(fileName);
+        sourceProcessor->setLanguageFeatures(parts.isEmpty()
+                                             ? CPlusPlus::LanguageFeatures::defaultFeatures()
+                                             : parts.first()->languageFeatures);
+        sourceProcessor->setHeaderPaths(parts.isEmpty() ? cmm->headerPaths()
+                                                        : parts.first()->headerPaths);
+        const bool isSourceFile = i < sources.size();
+
+        timer.start();
+        if (isSourceFile || i == sources.size())
+            sourceProcessor->run(conf);
+        sourceProcessor->run(fileName);
+        indexTime += timer.nsecsElapsed();
+        const CPlusPlus::Snapshot snapshot = sourceProcessor->snapshot();
+        if (isSourceFile)
+            sourceProcessor->resetEnvironment();
+
+        QFile file;
+        QByteArray source;
+        QString error;
+        if (params.workingCopy.contains(fileName)) {
+            source = params.workingCopy.source(fileName);
+        } else {
+            file.setFileName(fileName);
+            if (Utils::TextFileFormat::mapFileUTF8(&file, Core::EditorManager::defaultTextCodec(),
+                                                   &source, &error)
+                    != Utils::TextFileFormat::ReadSuccess) {
+                continue;
+            }
+        }
+        bytes += source.size();
+
+        timer.start();
+        CPlusPlus::Document::Ptr document
+                = snapshot.preprocessedDocument(source, Utils::FileName::fromString(fileName));
+        preprocessTime += timer.nsecsElapsed();
+        timer.start();
+        document->tokenize();
+        lexTime += timer.nsecsElapsed();
+        timer.start();
+        document->parse();
+        parseTime += timer.nsecsElapsed();
+        timer.start();
+        document->check();
+        bindTime += timer.nsecsElapsed();
+        timer.start();
+        CPlusPlus::LookupContext context(document, snapshot);
+        CheckSymbols::go(document, context, QList<CheckSymbols::Result>()).waitForFinished();
+        lookupTime += timer.nsecsElapsed();
+
+        future.setProgressValue(i + 1);
+    }
+
+    const double indexSeconds = qMax(seconds(indexTime), 1e-9);
+    qDebug("BenchmarkIndexing: %d files, %lld bytes indexed in %.3f s: %.1f files/s, %.1f KiB/s",
+           i, bytes, indexSeconds, i / indexSeconds, bytes / 1024.0 / indexSeconds);
+    qDebug("BenchmarkIndexing: preprocess %.3f s, lex %.3f s, parse %.3f s, bind %.3f s, "
+           "lookup %.3f s", seconds(preprocessTime), seconds(lexTime), seconds(parseTime),
+           seconds(bindTime), seconds(lookupTime));
+    qDebug("BenchmarkIndexing: peak memory %lld KiB", peakMemory());
+}
+
+// takes files from the shared list until it is exhausted; sources come first, so they are
+// spread over all workers before the first one continues with the headers
+static void indexWorker(QFutureInterface<void> &future, const ParseParams &params,
+                        const QStringList &files, int sourceCount, QAtomicInt *next,
+                        QAtomicInt *done, SharedDocuments *shared)
+{
+    QScopedPointer<CppSourceProcessor> sourceProcessor(CppModelManager::createSourceProcessor());
+    sourceProcessor->setHeaderPaths(params.headerPaths);
+    sourceProcessor->setWorkingCopy(params.workingCopy);
+    sourceProcessor->setSharedDocuments(shared);
+
+    foreach (const QString &file, params.sourceFiles)
+        sourceProcessor->removeFromCache(file);
 
     const QString conf = CppModelManager::configurationFileName();
     bool processingHeaders = false;
@@ -199,7 +313,7 @@ static void index(QFutureInterface<void> &future, const ParseParams params)
     const ProjectPart::HeaderPaths fallbackHeaderPaths = cmm->headerPaths();
     const CPlusPlus::LanguageFeatures defaultFeatures =
             CPlusPlus::LanguageFeatures::defaultFeatures();
-    for (int i = 0; i < files.size(); ++i) {
+    for (int i = next->fetchAndAddOrdered(1); i < files.size(); i = next->fetchAndAddOrdered(1)) {
         if (future.isPaused())
             future.waitForResume();
 
@@ -228,13 +342,43 @@ static void index(QFutureInterface<void> &future, const ParseParams params)
         sourceProcessor->setHeaderPaths(headerPaths);
         sourceProcessor->run(fileName);
 
-        future.setProgressValue(files.size() - sourceProcessor->todo().size());
+        future.setProgressValue(done->fetchAndAddOrdered(1) + 1);
 
         if (isSourceFile)
             sourceProcessor->resetEnvironment();
     }
 }
 
+static void index(QFutureInterface<void> &future, const ParseParams params)
+{
+    QStringList sources;
+    QStringList headers;
+    classifyFiles(params.sourceFiles, &headers, &sources);
+
+    const int sourceCount = sources.size();
+    const QStringList files = sources + headers;
+
+    // each worker has its own source processor and environment; the documents they finish are
+    // shared, so the common headers are processed only once
+    const int workerCount = qBound(1, QThread::idealThreadCount(), sourceCount);
+    QAtomicInt next(0);
+    QAtomicInt done(0);
+    if (workerCount == 1) {
+        indexWorker(future, params, files, sourceCount, &next, &done, 0);
+        return;
+    }
+    SharedDocuments shared;
+    QList<int> workers;
+    for (int i = 0; i < workerCount; ++i)
+        workers << i;
+    // This thread waits for blockingMap to finish, so let the pool use one more thread meanwhile
+    QThreadPool::globalInstance()->releaseThread();
+    QtConcurrent::blockingMap(workers, [&](int) {
+        indexWorker(future, params, files, sourceCount, &next, &done, &shared);
+    });
+    QThreadPool::globalInstance()->reserveThread();
+}
+
 static void parse(QFutureInterface<void> &future, const ParseParams params)
 {
     const QSet<QString> &files = params.sourceFiles;
@@ -245,6 +389,8 @@ static void parse(QFutureInterface<void> &future, const ParseParams params)
 
     if (FindErrorsIndexing)
         indexFindErrors(future, params);
+    else if (BenchmarkIndexing)
+        indexBenchmark(future, params);
     else
         index(future, params);
 
@@ -40,6 +40,7 @@
 #include <cplusplus/Overview.h>
 #include <QtConcurrentMap>
 #include <QDir>
+#include <QFile>
 
 #include <functional>
 
@@ -48,12 +49,27 @@ using namespace CppTools::Internal;
 using namespace CppTools;
 using namespace CPlusPlus;
 
+// Without a working copy entry, the source of a file which needs no transcoding and has
+// LF line endings refers to its mapping in \a mapped, if given
 static QByteArray getSource(const Utils::FileName &fileName,
-                            const WorkingCopy &workingCopy)
+                            const WorkingCopy &workingCopy,
+                            QFile *mapped = 0)
 {
     if (workingCopy.contains(fileName)) {
         return workingCopy.source(fileName);
     } else {
+        if (mapped) {
+            QByteArray source;
+            QString error;
+            mapped->setFileName(fileName.toString());
+            if (Utils::TextFileFormat::mapFileUTF8(mapped, EditorManager::defaultTextCodec(),
+                                                   &source, &error)
+                    == Utils::TextFileFormat::ReadSuccess
+                    && !source.contains('\r')) {
+                return source;
+            }
+            mapped->close();
+        }
         QString fileContents;
         Utils::TextFileFormat format;
         QString error;
@@ -196,7 +212,8 @@ public:
                 return usages; // skip this document, it's not using symbolId.
         }
         Document::Ptr doc;
-        const QByteArray unpreprocessedSource = getSource(fileName, workingCopy);
+        QFile file;
+        const QByteArray unpreprocessedSource = getSource(fileName, workingCopy, &file);
 
         if (symbolDocument && fileName == Utils::FileName::fromString(symbolDocument->fileName())) {
             doc = symbolDocument;
@@ -261,6 +278,19 @@ QList<int> CppFindReferences::references(Symbol *symbol, const LookupContext &co
     return references;
 }
 
+// uses the dependency table of the model manager instead of building one from the snapshot
+static Utils::FileNameList filesDependingOn(const Snapshot &snapshot,
+                                            const Utils::FileName &sourceFile)
+{
+    Utils::FileNameList files;
+    const DependencyTable deps = CppModelManager::instance()->dependencyTable();
+    foreach (const Utils::FileName &file, deps.filesDependingOn(sourceFile)) {
+        if (snapshot.contains(file))
+            files.append(file);
+    }
+    return files;
+}
+
 static void find_helper(QFutureInterface<Usage> &future,
                         const WorkingCopy workingCopy,
                         const LookupContext context,
@@ -291,7 +321,7 @@ static void find_helper(QFutureInterface<Usage> &future,
                 files.append(i.key());
         }
     } else {
-        files += snapshot.filesDependingOn(sourceFile);
+        files += filesDependingOn(snapshot, sourceFile);
     }
     files.removeDuplicates();
 
@@ -611,7 +641,7 @@ static void findMacroUses_helper(QFutureInterface<Usage> &future,
 {
     const Utils::FileName sourceFile = Utils::FileName::fromString(macro.fileName());
     Utils::FileNameList files(sourceFile);
-    files += snapshot.filesDependingOn(sourceFile);
+    files += filesDependingOn(snapshot, sourceFile);
     files.removeDuplicates();
 
     future.setProgressRange(0, files.size());
@@ -0,0 +1,96 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "cppincludedircache.h"
+
+#include <utils/hostosinfo.h>
+
+#include <QDir>
+#include <QFileInfo>
+
+using namespace CppTools::Internal;
+
+IncludeDirCache::IncludeDirCache(QObject *parent)
+    : QObject(parent)
+{
+    connect(&m_watcher, &Utils::FileSystemWatcher::directoryChanged,
+            this, &IncludeDirCache::directoryChanged);
+}
+
+bool IncludeDirCache::isFile(const QString &filePath)
+{
+    const int slash = filePath.lastIndexOf(QLatin1Char('/'));
+    if (slash < 1) {
+        const QFileInfo fileInfo(filePath);
+        return fileInfo.isFile() && fileInfo.isReadable();
+    }
+    const QString dirPath = QDir::cleanPath(filePath.left(slash));
+    const QString fileName = key(filePath.mid(slash + 1));
+
+    {
+        QMutexLocker locker(&m_mutex);
+        QHash<QString, Listing>::const_iterator it = m_listings.constFind(dirPath);
+        if (it != m_listings.constEnd())
+            return it->fileNames.contains(fileName);
+    }
+
+    // Missing directories are not cached, they might be created later on
+    const QFileInfo dirInfo(dirPath);
+    if (!dirInfo.isDir())
+        return false;
+
+    Listing listing;
+    listing.lastModified = dirInfo.lastModified();
+    const QStringList entries = QDir(dirPath).entryList(QDir::Files | QDir::Readable
+                                                        | QDir::Hidden | QDir::System);
+    foreach (const QString &entry, entries)
+        listing.fileNames.insert(key(entry));
+    const bool found = listing.fileNames.contains(fileName);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_listings.insert(dirPath, listing);
+    }
+    // The watcher belongs to the thread of this object
+    QMetaObject::invokeMethod(this, "watch", Qt::QueuedConnection, Q_ARG(QString, dirPath));
+    return found;
+}
+
+void IncludeDirCache::watch(const QString &dirPath)
+{
+    if (!m_watcher.watchesDirectory(dirPath))
+        m_watcher.addDirectory(dirPath, Utils::FileSystemWatcher::WatchAllChanges);
+
+    // The directory might have changed since it was listed, also when it was watched already
+    // and the change was reported before the listing was inserted
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Listing>::iterator it = m_listings.find(dirPath);
+    if (it != m_listings.end() && QFileInfo(dirPath).lastModified() != it->lastModified)
+        m_listings.erase(it);
+}
+
+void IncludeDirCache::directoryChanged(const QString &dirPath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_listings.remove(dirPath);
+}
+
+QString IncludeDirCache::key(const QString &fileName)
+{
+    if (Utils::HostOsInfo::fileNameCaseSensitivity() == Qt::CaseInsensitive)
+        return fileName.toLower();
+    return fileName;
+}
@@ -0,0 +1,63 @@
+#ifndef CPPINCLUDEDIRCACHE_H
+#define CPPINCLUDEDIRCACHE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <utils/filesystemwatcher.h>
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+
+namespace CppTools {
+namespace Internal {
+
+// Listings of the directories includes are looked up in, so resolving an include takes a hash
+// lookup per header path instead of a stat. The listings are shared by all source processors
+// and dropped as soon as the watched directory changes. Thread-safe.
+class IncludeDirCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IncludeDirCache(QObject *parent = 0);
+
+    bool isFile(const QString &filePath);
+
+private slots:
+    void watch(const QString &dirPath);
+    void directoryChanged(const QString &dirPath);
+
+private:
+    struct Listing
+    {
+        QSet<QString> fileNames;
+        QDateTime lastModified;
+    };
+
+    static QString key(const QString &fileName);
+
+    QMutex m_mutex;
+    QHash<QString, Listing> m_listings;
+    Utils::FileSystemWatcher m_watcher;
+};
+
+} // namespace Internal
+} // namespace CppTools
+
+#endif // CPPINCLUDEDIRCACHE_H
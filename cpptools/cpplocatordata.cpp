@@ -31,20 +31,124 @@
 #include "cpplocatordata.h"
 #include "cpptoolsplugin.h"
 
+#include <core/icore.h>
+#include <utils/qtcassert.h>
+
+#include <QtConcurrentRun>
+
 using namespace CppTools;
 using namespace CppTools::Internal;
 
-enum { MaxPendingDocuments = 10 };
-
 CppLocatorData::CppLocatorData()
     : m_strings(&CppToolsPlugin::stringTable())
+    , m_symbolStrings(new SymbolStrings)
+    , m_liveSymbolStrings(0)
     , m_search(CppToolsPlugin::stringTable())
     , m_pendingDocumentsMutex(QMutex::Recursive)
+    , m_indexing(false)
+    , m_loading(0)
 {
     m_search.setSymbolsToSearchFor(SymbolSearcher::Enums |
                                    SymbolSearcher::Classes |
                                    SymbolSearcher::Functions);
-    m_pendingDocuments.reserve(MaxPendingDocuments);
+    if (m_cache.open(Core::ICore::userResourcePath() + QLatin1Char('/') + SymbolCache::fileName()))
+        m_loaders.append(QtConcurrent::run(&m_cache, &SymbolCache::prune,
+                                           &m_stopLoading));
+}
+
+CppLocatorData::~CppLocatorData()
+{
+    QMutexLocker locker(&m_pendingDocumentsMutex);
+    m_pendingDocuments.clear();
+    locker.unlock();
+    m_stopLoading.store(1);
+    foreach (QFuture<void> loader, m_loaders)
+        loader.waitForFinished();
+    m_indexer.waitForFinished();
+}
+
+void CppLocatorData::loadCached(const QStringList &files)
+{
+    QList<QFuture<void> >::iterator it = m_loaders.begin();
+    while (it != m_loaders.end()) {
+        if (it->isFinished())
+            it = m_loaders.erase(it);
+        else
+            ++it;
+    }
+    QMutexLocker locker(&m_pendingDocumentsMutex);
+    ++m_loading;
+    locker.unlock();
+    m_loaders.append(QtConcurrent::run(this, &CppLocatorData::loadCachedFiles, files));
+}
+
+void CppLocatorData::loadCachedFiles(const QStringList &files)
+{
+    QMutexLocker locker(&m_pendingDocumentsMutex);
+    const QSharedPointer<SymbolStrings> strings = m_symbolStrings;
+    locker.unlock();
+
+    QHash<QString, FileSymbols> cached;
+    foreach (const QString &file, files) {
+        if (m_stopLoading.load())
+            break;
+        if (IndexItem::Ptr item = m_cache.load(file, *m_strings))
+            cached.insert(item->fileName(), FileSymbols::fromItem(item, strings));
+    }
+
+    // handed over to indexPendingDocuments, which does not replace the indexed symbols
+    locker.relock();
+    for (auto i = cached.constBegin(), ei = cached.constEnd(); i != ei; ++i) {
+        if (!m_removedWhileLoading.contains(i.key()))
+            m_pendingCached.insert(i.key(), i.value());
+    }
+    if (--m_loading == 0)
+        m_removedWhileLoading.clear();
+    if (!m_pendingCached.isEmpty())
+        startIndexing();
+}
+
+QList<CppLocatorData::FileMatches> CppLocatorData::filesMatching(
+        const Core::LocatorMatcher &matcher) const
+{
+    QSet<QString> removed;
+    const Symbols current = symbols(&removed);
+    QList<FileMatches> files;
+    QVector<int> ids;
+    if (!matcher.candidates(current.index, &ids)) {
+        for (auto i = current.infosByFile.constBegin(), ei = current.infosByFile.constEnd();
+             i != ei; ++i) {
+            if (!removed.contains(i.key())) {
+                FileMatches matches;
+                matches.file = i.value();
+                files.append(matches);
+            }
+        }
+        return files;
+    }
+
+    // the candidates are ascending, so the symbols of a file come in one run
+    int first = 0;
+    int end = 0;
+    bool skip = true;
+    foreach (int id, ids) {
+        if (id >= end) {
+            skip = true;
+            QMap<int, QString>::const_iterator it = current.filesByFirstId.upperBound(id);
+            QTC_ASSERT(it != current.filesByFirstId.constBegin(), continue);
+            --it;
+            FileMatches matches;
+            matches.file = current.infosByFile.value(it.value());
+            first = it.key();
+            end = first + matches.file.size();
+            skip = removed.contains(it.value());
+            if (!skip)
+                files.append(matches);
+        }
+        if (!skip)
+            files.last().records.append(id - first);
+    }
+    return files;
 }
 
 void CppLocatorData::onDocumentUpdated(const CPlusPlus::Document::Ptr &document)
@@ -63,7 +167,8 @@ void CppLocatorData::onDocumentUpdated(const CPlusPlus::Document::Ptr &document)
     if (i == ei && QFileInfo(document->fileName()).suffix() != QLatin1String("moc"))
         m_pendingDocuments.append(document);
 
-    flushPendingDocument(false);
+    if (!m_pendingDocuments.isEmpty())
+        startIndexing();
 }
 
 void CppLocatorData::onAboutToRemoveFiles(const QStringList &files)
@@ -74,7 +179,11 @@ void CppLocatorData::onAboutToRemoveFiles(const QStringList &files)
     QMutexLocker locker(&m_pendingDocumentsMutex);
 
     foreach (const QString &file, files) {
-        m_infosByFile.remove(file);
+        if (m_symbols.infosByFile.contains(file))
+            m_pendingRemovals.insert(file);
+        m_pendingCached.remove(file);
+        if (m_loading)
+            m_removedWhileLoading.insert(file);
 
         for (int i = 0; i < m_pendingDocuments.size(); ++i) {
             if (m_pendingDocuments.at(i)->fileName() == file) {
@@ -83,25 +192,122 @@ void CppLocatorData::onAboutToRemoveFiles(const QStringList &files)
             }
         }
     }
+    if (m_indexing) { // the running batch might still insert one of the files
+        const QSet<QString> removed = QSet<QString>::fromList(files);
+        m_pendingRemovals.unite(removed);
+        m_removedWhileIndexing.unite(removed);
+    }
+    if (!m_pendingRemovals.isEmpty())
+        startIndexing();
 
     m_strings->scheduleGC();
-    flushPendingDocument(false);
 }
 
-void CppLocatorData::flushPendingDocument(bool force) const
+CppLocatorData::Symbols CppLocatorData::symbols(QSet<QString> *removed) const
 {
-    // TODO: move this off the UI thread and into a future.
     QMutexLocker locker(&m_pendingDocumentsMutex);
-    if (!force && m_pendingDocuments.size() < MaxPendingDocuments)
-        return;
-    if (m_pendingDocuments.isEmpty())
+    *removed = m_pendingRemovals;
+    return m_symbols;
+}
+
+void CppLocatorData::startIndexing()
+{
+    // the changes arriving while a batch is applied make up the next batch
+    if (!m_indexing) {
+        m_indexing = true;
+        m_indexer = QtConcurrent::run(this, &CppLocatorData::indexPendingDocuments);
+    }
+}
+
+void CppLocatorData::indexPendingDocuments()
+{
+    QMutexLocker locker(&m_pendingDocumentsMutex);
+    while (!m_pendingDocuments.isEmpty() || !m_pendingRemovals.isEmpty()
+           || !m_pendingCached.isEmpty()) {
+        const QVector<CPlusPlus::Document::Ptr> documents = m_pendingDocuments;
+        const QSet<QString> removed = m_pendingRemovals;
+        const QHash<QString, FileSymbols> cached = m_pendingCached;
+        m_pendingDocuments.clear();
+        m_pendingCached.clear();
+        m_removedWhileIndexing.clear();
+        // This is the only place which replaces m_symbols; the copy is detached and updated
+        // without holding the lock, so readers are not blocked by the update.
+        Symbols next = m_symbols;
+        QSharedPointer<SymbolStrings> strings = m_symbolStrings;
+        locker.unlock();
+
+        QList<FileSymbols> files;
+        QList<IndexItem::Ptr> saved;
+        foreach (const CPlusPlus::Document::Ptr &doc, documents) {
+            const IndexItem::Ptr item = m_search(doc);
+            files.append(FileSymbols::fromItem(item, strings));
+            if (doc->editorRevision() == 0) // unsaved editor contents are not cached
+                saved.append(item);
+        }
+        m_cache.store(saved);
+
+        foreach (const QString &fileName, removed)
+            next.remove(fileName);
+        for (auto i = cached.constBegin(), ei = cached.constEnd(); i != ei; ++i) {
+            if (!next.infosByFile.contains(i.key())) // maybe loaded before a compaction
+                next.insert(i.key(), i.value().rebased(strings));
+        }
+        for (int i = 0; i < documents.size(); ++i)
+            next.insert(findOrInsertFilePath(documents.at(i)->fileName()), files.at(i));
+
+        // The interned strings are never freed one by one; once they more than doubled since
+        // the last compaction, the symbols are interned again into a new instance and the
+        // old one, with the strings of edited and removed symbols, goes with its last user.
+        if (strings->size() > 100000 && strings->size() > 2 * m_liveSymbolStrings) {
+            strings = QSharedPointer<SymbolStrings>(new SymbolStrings);
+            for (auto i = next.infosByFile.begin(), ei = next.infosByFile.end(); i != ei; ++i)
+                i.value() = i.value().rebased(strings);
+            m_liveSymbolStrings = strings->size();
+        }
+
+        locker.relock();
+        m_symbols = next;
+        m_symbolStrings = strings;
+        // files removed in the meantime stay hidden until the next batch removes them
+        m_pendingRemovals.subtract(removed);
+        m_pendingRemovals.unite(m_removedWhileIndexing);
+    }
+    m_indexing = false;
+}
+
+void CppLocatorData::Symbols::insert(const QString &fileName, const FileSymbols &file)
+{
+    remove(fileName);
+    infosByFile.insert(fileName, file);
+    if (file.size() == 0)
         return;
 
-    foreach (CPlusPlus::Document::Ptr doc, m_pendingDocuments)
-        m_infosByFile.insert(findOrInsertFilePath(doc->fileName()), m_search(doc));
+    // Same symbols as visited by CppLocatorFilter; the scoped name includes the plain one,
+    // and so do its humps. The enumerators are not visited and get no trigrams.
+    int first = -1;
+    for (int i = 0; i < file.size(); ) {
+        const int end = file.type(i) & IndexItem::Enum ? file.end(i) : i + 1;
+        const QString name = file.scopedSymbolName(i);
+        const int id = index.insert(QStringList() << name << Core::LocatorMatcher::humps(name));
+        if (first < 0)
+            first = id;
+        for (++i; i < end; ++i)
+            index.insert(QStringList());
+    }
+    firstIdByFile.insert(fileName, first);
+    filesByFirstId.insert(first, fileName);
+}
 
-    m_pendingDocuments.clear();
-    m_pendingDocuments.reserve(MaxPendingDocuments);
+void CppLocatorData::Symbols::remove(const QString &fileName)
+{
+    const FileSymbols file = infosByFile.take(fileName);
+    QHash<QString, int>::iterator it = firstIdByFile.find(fileName);
+    if (it == firstIdByFile.end())
+        return;
+    for (int id = it.value(), end = it.value() + file.size(); id < end; ++id)
+        index.remove(id);
+    filesByFirstId.remove(it.value());
+    firstIdByFile.erase(it);
 }
 
 QList<IndexItem::Ptr> CppLocatorData::allIndexItems(
@@ -32,12 +32,20 @@
 #define CPPLOCATORDATA_H
 
 #include <functional>
+#include <QAtomicInt>
+#include <QFuture>
 #include <QHash>
+#include <QMap>
+#include <QSet>
 
 #include <cplusplus/CppDocument.h>
+#include <core/locator/locatormatcher.h>
+#include <core/locator/trigramindex.h>
 
 #include "cpptools_global.h"
+#include "cpplocatorsymbols.h"
 #include "cppmodelmanager.h"
+#include "cppsymbolcache.h"
 #include "searchsymbols.h"
 #include "stringtable.h"
 
@@ -56,23 +64,44 @@ class CppLocatorData : public QObject
     friend class Internal::CppToolsPlugin;
 
 public:
-    void filterAllFiles(IndexItem::Visitor func) const
+    ~CppLocatorData();
+
+    struct FileMatches
     {
-        flushPendingDocument(true);
-        QMutexLocker locker(&m_pendingDocumentsMutex);
-        QHash<QString, IndexItem::Ptr> infosByFile = m_infosByFile;
-        locker.unlock();
-        for (auto i = infosByFile.constBegin(), ei = infosByFile.constEnd(); i != ei; ++i)
-            if (i.value()->visitAllChildren(func) == IndexItem::Break)
-                return;
-    }
+        Internal::FileSymbols file;
+        QVector<int> records; // which might match, ascending; all records of file if empty
+    };
+    // The symbols which might match, by file.
+    QList<FileMatches> filesMatching(const Core::LocatorMatcher &matcher) const;
+
+    // Shows the cached symbols of files which were not indexed yet in this session; they are
+    // loaded in a worker thread.
+    void loadCached(const QStringList &files);
 
 public slots:
     void onDocumentUpdated(const CPlusPlus::Document::Ptr &document);
     void onAboutToRemoveFiles(const QStringList &files);
 
 private:
-    void flushPendingDocument(bool force) const;
+    // Only consists of implicitly shared containers, so a copy is a consistent snapshot which
+    // can be used without locking while the original is updated.
+    struct Symbols
+    {
+        void insert(const QString &fileName, const Internal::FileSymbols &file);
+        void remove(const QString &fileName);
+
+        QHash<QString, Internal::FileSymbols> infosByFile;
+        // one entry per record, so the ids of a file are consecutive and the id minus the
+        // first id of the file is the record
+        Core::TrigramIndex index;
+        QHash<QString, int> firstIdByFile;
+        QMap<int, QString> filesByFirstId;
+    };
+
+    Symbols symbols(QSet<QString> *removed) const;
+    void loadCachedFiles(const QStringList &files);
+    void startIndexing();
+    void indexPendingDocuments();
     QList<IndexItem::Ptr> allIndexItems(const QHash<QString, QList<IndexItem::Ptr>> &items) const;
 
     QString findOrInsertFilePath(const QString &path) const
@@ -80,12 +109,26 @@ private:
 
 private:
     Internal::StringTable *m_strings; // Used to avoid QString duplication
-
-    mutable SearchSymbols m_search;
-    mutable QHash<QString, IndexItem::Ptr> m_infosByFile;
-
-    mutable QMutex m_pendingDocumentsMutex;
-    mutable QVector<CPlusPlus::Document::Ptr> m_pendingDocuments;
+    // of the symbols added to m_symbols; only replaced by indexPendingDocuments
+    QSharedPointer<Internal::SymbolStrings> m_symbolStrings;
+    int m_liveSymbolStrings; // in m_symbolStrings when it was created
+
+    SearchSymbols m_search; // only used by indexPendingDocuments
+    Symbols m_symbols; // only replaced by indexPendingDocuments
+
+    mutable QMutex m_pendingDocumentsMutex; // also guards m_symbols and the pending changes
+    QVector<CPlusPlus::Document::Ptr> m_pendingDocuments;
+    QSet<QString> m_pendingRemovals; // still in m_symbols, but hidden from filesMatching
+    QHash<QString, Internal::FileSymbols> m_pendingCached;
+    bool m_indexing; // the pending changes are applied by indexPendingDocuments
+    QSet<QString> m_removedWhileIndexing;
+    QFuture<void> m_indexer;
+    int m_loading; // running loadCachedFiles
+    QSet<QString> m_removedWhileLoading;
+    QList<QFuture<void> > m_loaders;
+    QAtomicInt m_stopLoading;
+
+    Internal::SymbolCache m_cache;
 };
 
 } // CppTools namespace
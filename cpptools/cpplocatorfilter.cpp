@@ -25,12 +25,17 @@
 #include "cppmodelmanager.h"
 
 #include <core/editormanager/editormanager.h>
+#include <core/locator/locatormatcher.h>
 
-#include <QStringMatcher>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
 
 using namespace CppTools;
 using namespace CppTools::Internal;
 
+enum { MinShardSize = 50 }; // files, not worth a thread below
+
 CppLocatorFilter::CppLocatorFilter(CppLocatorData *locatorData)
     : m_data(locatorData)
 {
@@ -61,56 +66,67 @@ void CppLocatorFilter::refresh(QFutureInterface<void> &future)
     Q_UNUSED(future)
 }
 
-static bool compareLexigraphically(const Core::LocatorFilterEntry &a,
-                                   const Core::LocatorFilterEntry &b)
-{
-    return a.displayName < b.displayName;
-}
-
 QList<Core::LocatorFilterEntry> CppLocatorFilter::matchesFor(
         QFutureInterface<Core::LocatorFilterEntry> &future, const QString &origEntry)
 {
     QString entry = trimWildcards(origEntry);
-    QList<Core::LocatorFilterEntry> goodEntries;
-    QList<Core::LocatorFilterEntry> betterEntries;
-    const QChar asterisk = QLatin1Char('*');
-    QStringMatcher matcher(entry, Qt::CaseInsensitive);
-    QRegExp regexp(asterisk + entry+ asterisk, Qt::CaseInsensitive, QRegExp::Wildcard);
-    if (!regexp.isValid())
-        return goodEntries;
-    bool hasWildcard = (entry.contains(asterisk) || entry.contains(QLatin1Char('?')));
+    const Core::LocatorMatcher matcher(entry);
+    if (!matcher.isValid())
+        return QList<Core::LocatorFilterEntry>();
     bool hasColonColon = entry.contains(QLatin1String("::"));
-    const Qt::CaseSensitivity caseSensitivityForPrefix = caseSensitivity(entry);
     const IndexItem::ItemType wanted = matchTypes();
 
-    m_data->filterAllFiles([&](const IndexItem::Ptr &info) -> IndexItem::VisitorResult {
-        if (future.isCanceled())
-            return IndexItem::Break;
-        if (info->type() & wanted) {
-            const QString matchString = hasColonColon ? info->scopedSymbolName() : info->symbolName();
-            if ((hasWildcard && regexp.exactMatch(matchString)) ||
-                    (!hasWildcard && matcher.indexIn(matchString) != -1)) {
-                const Core::LocatorFilterEntry filterEntry = filterEntryFromIndexItem(info);
-                if (matchString.startsWith(entry, caseSensitivityForPrefix))
-                    betterEntries.append(filterEntry);
-                else
-                    goodEntries.append(filterEntry);
+    // each shard of the files is matched by its own thread, keeping its own best results
+    const QList<CppLocatorData::FileMatches> files = m_data->filesMatching(matcher);
+    const int shardCount = qBound(1, QThread::idealThreadCount(), files.size() / MinShardSize);
+    QVector<Core::LocatorResults> shardResults(shardCount);
+    auto matchShard = [&](int shard) {
+        Core::LocatorResults &results = shardResults[shard];
+        auto matchSymbol = [&](const FileSymbols &file, int i) {
+            if (file.type(i) & wanted) {
+                const QString matchString = hasColonColon ? file.scopedSymbolName(i)
+                                                          : file.symbolName(i);
+                const int score = matcher.score(matchString);
+                if (score != Core::LocatorMatcher::NoMatch && results.accepts(score))
+                    results.add(score, filterEntryFromIndexItem(file.item(i, m_icons)));
+            }
+        };
+        for (int f = shard; f < files.size(); f += shardCount) {
+            const FileSymbols &file = files.at(f).file;
+            const QVector<int> &records = files.at(f).records;
+            if (!records.isEmpty()) {
+                foreach (int i, records) {
+                    if (future.isCanceled())
+                        return;
+                    matchSymbol(file, i);
+                }
+                continue;
+            }
+            for (int i = 0; i < file.size(); ) {
+                if (future.isCanceled())
+                    return;
+                matchSymbol(file, i);
+                i = file.type(i) & IndexItem::Enum ? file.end(i) : i + 1;
             }
         }
-
-        if (info->type() & IndexItem::Enum)
-            return IndexItem::Continue;
-        else
-            return IndexItem::Recurse;
-    });
-
-    if (goodEntries.size() < 1000)
-        qStableSort(goodEntries.begin(), goodEntries.end(), compareLexigraphically);
-    if (betterEntries.size() < 1000)
-        qStableSort(betterEntries.begin(), betterEntries.end(), compareLexigraphically);
-
-    betterEntries += goodEntries;
-    return betterEntries;
+    };
+
+    if (shardCount == 1) {
+        matchShard(0);
+        return shardResults.first().entries();
+    }
+    QList<int> shards;
+    for (int i = 0; i < shardCount; ++i)
+        shards << i;
+    // This thread waits for blockingMap to finish, so let the pool use one more thread meanwhile
+    QThreadPool::globalInstance()->releaseThread();
+    QtConcurrent::blockingMap(shards, matchShard);
+    QThreadPool::globalInstance()->reserveThread();
+
+    Core::LocatorResults results;
+    foreach (const Core::LocatorResults &shard, shardResults)
+        results.add(shard);
+    return results.entries();
 }
 
 void CppLocatorFilter::accept(Core::LocatorFilterEntry selection) const
@@ -51,6 +51,8 @@ protected:
 
 protected:
     CppLocatorData *m_data;
+    CPlusPlus::Icons m_icons; // for the items of the matches
+
 };
 
 } // namespace Internal
@@ -0,0 +1,166 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "cpplocatorsymbols.h"
+
+#include <utils/qtcassert.h>
+
+using namespace CppTools;
+using namespace CppTools::Internal;
+
+// The id of a string is 1 + its index in the shard, shifted left, or'ed with the shard.
+// Readers get ids only through data published under a mutex after insert returned, so the
+// chunk and the string written by insert are visible to them.
+
+SymbolStrings::SymbolStrings()
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        m_shards[i].count = 0;
+        for (int j = 0; j < MaxChunks; ++j)
+            m_shards[i].chunks[j] = 0;
+    }
+}
+
+SymbolStrings::~SymbolStrings()
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        for (int j = 0; j < MaxChunks; ++j)
+            delete[] m_shards[i].chunks[j];
+    }
+}
+
+quint32 SymbolStrings::insert(const QString &string)
+{
+    if (string.isEmpty())
+        return 0;
+
+    const uint shardIndex = qHash(string) & (ShardCount - 1);
+    Shard &shard = m_shards[shardIndex];
+    QMutexLocker locker(&shard.mutex);
+    QHash<QString, quint32>::const_iterator it = shard.ids.constFind(string);
+    if (it != shard.ids.constEnd())
+        return it.value();
+
+    const quint32 index = shard.count;
+    QTC_ASSERT(index < quint32(ChunkSize * MaxChunks), return 0);
+    QString *&chunk = shard.chunks[index / ChunkSize];
+    if (!chunk)
+        chunk = new QString[ChunkSize];
+    chunk[index % ChunkSize] = string;
+    ++shard.count;
+    const quint32 id = (index + 1) << ShardBits | shardIndex;
+    shard.ids.insert(string, id);
+    return id;
+}
+
+const QString &SymbolStrings::string(quint32 id) const
+{
+    static const QString empty;
+    if (id == 0)
+        return empty;
+    const Shard &shard = m_shards[id & (ShardCount - 1)];
+    const quint32 index = (id >> ShardBits) - 1;
+    return shard.chunks[index / ChunkSize][index % ChunkSize];
+}
+
+int SymbolStrings::size() const
+{
+    int size = 0;
+    for (int i = 0; i < ShardCount; ++i) {
+        QMutexLocker locker(&m_shards[i].mutex);
+        size += m_shards[i].count;
+    }
+    return size;
+}
+
+FileSymbols::FileSymbols()
+    : m_fileName(0)
+{
+}
+
+FileSymbols FileSymbols::fromItem(const IndexItem::Ptr &root,
+                                  const QSharedPointer<SymbolStrings> &strings)
+{
+    FileSymbols symbols;
+    symbols.m_strings = strings;
+    symbols.m_fileName = strings->insert(root->fileName());
+
+    IndexItem::Visitor add = [&](const IndexItem::Ptr &item) -> IndexItem::VisitorResult {
+        const int i = symbols.m_names.size();
+        symbols.m_names.append(strings->insert(item->symbolName()));
+        symbols.m_symbolTypes.append(strings->insert(item->symbolType()));
+        symbols.m_scopes.append(strings->insert(item->symbolScope()));
+        symbols.m_lines.append(item->line());
+        symbols.m_columns.append(item->column());
+        symbols.m_ends.append(0);
+        symbols.m_types.append(quint8(item->type()));
+        symbols.m_iconTypes.append(qint8(item->iconType()));
+        item->visitAllChildren(add);
+        symbols.m_ends[i] = symbols.m_names.size();
+        return IndexItem::Continue;
+    };
+    root->visitAllChildren(add);
+
+    symbols.m_names.squeeze();
+    symbols.m_symbolTypes.squeeze();
+    symbols.m_scopes.squeeze();
+    symbols.m_lines.squeeze();
+    symbols.m_columns.squeeze();
+    symbols.m_ends.squeeze();
+    symbols.m_types.squeeze();
+    symbols.m_iconTypes.squeeze();
+    return symbols;
+}
+
+static QVector<quint32> rebasedIds(const QVector<quint32> &ids, const SymbolStrings *from,
+                                   SymbolStrings *to)
+{
+    QVector<quint32> result(ids.size());
+    for (int i = 0; i < ids.size(); ++i)
+        result[i] = to->insert(from->string(ids.at(i)));
+    return result;
+}
+
+FileSymbols FileSymbols::rebased(const QSharedPointer<SymbolStrings> &strings) const
+{
+    if (m_strings == strings || !m_strings)
+        return *this;
+    FileSymbols symbols = *this;
+    symbols.m_strings = strings;
+    symbols.m_fileName = strings->insert(fileName());
+    symbols.m_names = rebasedIds(m_names, m_strings.data(), strings.data());
+    symbols.m_symbolTypes = rebasedIds(m_symbolTypes, m_strings.data(), strings.data());
+    symbols.m_scopes = rebasedIds(m_scopes, m_strings.data(), strings.data());
+    return symbols;
+}
+
+QString FileSymbols::scopedSymbolName(int i) const
+{
+    const QString &scope = m_strings->string(m_scopes.at(i));
+    return scope.isEmpty()
+            ? symbolName(i)
+            : scope + QLatin1String("::") + symbolName(i);
+}
+
+IndexItem::Ptr FileSymbols::item(int i, const CPlusPlus::Icons &icons) const
+{
+    const int iconType = m_iconTypes.at(i);
+    const QIcon icon = iconType >= 0
+            ? icons.iconForType(CPlusPlus::Icons::IconType(iconType)) : QIcon();
+    return IndexItem::create(symbolName(i), m_strings->string(m_symbolTypes.at(i)),
+                             m_strings->string(m_scopes.at(i)), type(i), fileName(),
+                             m_lines.at(i), m_columns.at(i), icon, iconType);
+}
@@ -0,0 +1,98 @@
+#ifndef CPPLOCATORSYMBOLS_H
+#define CPPLOCATORSYMBOLS_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "indexitem.h"
+
+#include <cplusplus/Icons.h>
+
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+
+namespace CppTools {
+namespace Internal {
+
+// Assigns 32 bit ids to strings. Inserting is thread-safe and locks only one of several shards;
+// looking up the string of an id needs no lock, since the strings are never moved or removed.
+// Unused strings are reclaimed by interning the live symbols into a new instance, see
+// FileSymbols::rebased; the FileSymbols keep the instance of their ids alive.
+class SymbolStrings
+{
+    Q_DISABLE_COPY(SymbolStrings)
+public:
+    SymbolStrings();
+    ~SymbolStrings();
+
+    quint32 insert(const QString &string); // the empty string has id 0
+    const QString &string(quint32 id) const;
+    int size() const;
+
+private:
+    enum { ShardBits = 4, ShardCount = 1 << ShardBits, ChunkSize = 1024, MaxChunks = 4096 };
+
+    struct Shard
+    {
+        mutable QMutex mutex;
+        QHash<QString, quint32> ids;
+        QString *chunks[MaxChunks];
+        quint32 count;
+    };
+    Shard m_shards[ShardCount];
+};
+
+// The locator symbols of one file, one record per IndexItem below the root in the order of
+// IndexItem::visitAllChildren, each field in its own array. A copy shares the arrays.
+class FileSymbols
+{
+public:
+    FileSymbols();
+
+    static FileSymbols fromItem(const IndexItem::Ptr &root,
+                                const QSharedPointer<SymbolStrings> &strings);
+    // The same symbols with their strings interned in the given instance
+    FileSymbols rebased(const QSharedPointer<SymbolStrings> &strings) const;
+    const SymbolStrings *strings() const { return m_strings.data(); }
+
+    QString fileName() const { return m_strings->string(m_fileName); }
+    int size() const { return m_names.size(); }
+    int end(int i) const { return m_ends.at(i); } // the record following the children of i
+    IndexItem::ItemType type(int i) const { return IndexItem::ItemType(m_types.at(i)); }
+    QString symbolName(int i) const { return m_strings->string(m_names.at(i)); }
+    QString scopedSymbolName(int i) const;
+
+    IndexItem::Ptr item(int i, const CPlusPlus::Icons &icons) const; // without children
+
+private:
+    QSharedPointer<const SymbolStrings> m_strings;
+    quint32 m_fileName;
+    QVector<quint32> m_names;
+    QVector<quint32> m_symbolTypes;
+    QVector<quint32> m_scopes;
+    QVector<qint32> m_lines;
+    QVector<qint32> m_columns;
+    QVector<qint32> m_ends;
+    QVector<quint8> m_types;
+    QVector<qint8> m_iconTypes;
+};
+
+} // namespace Internal
+} // namespace CppTools
+
+#endif // CPPLOCATORSYMBOLS_H
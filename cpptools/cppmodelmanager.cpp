@@ -29,6 +29,7 @@
 #include "cppcodemodelinspectordumper.h"
 #include "cppcodemodelsettings.h"
 #include "cppfindreferences.h"
+#include "cppincludedircache.h"
 #include "cppindexingsupport.h"
 #include "cppmodelmanagersupportinternal.h"
 #include "cpprefactoringchanges.h"
@@ -44,13 +45,16 @@
 #include <core/progressmanager/progressmanager.h>
 #include <core/editormanager/editormanager.h>
 #include <texteditor/textdocument.h>
+#include <projectexplorer/buildconfiguration.h>
 #include <projectexplorer/project.h>
 #include <projectexplorer/projectexplorer.h>
 #include <projectexplorer/session.h>
+#include <projectexplorer/target.h>
 #include <extensionsystem/pluginmanager.h>
 #include <utils/algorithm.h>
 #include <utils/fileutils.h>
 #include <utils/qtcassert.h>
+#include <utils/textfileformat.h>
 
 #include <QCoreApplication>
 #include <QDebug>
@@ -127,6 +131,17 @@ public:
     // Snapshot
     mutable QMutex m_snapshotMutex;
     Snapshot m_snapshot;
+    mutable DependencyTable m_dependencyTable; // of m_snapshot, closures updated on demand
+    int m_dependencyTableRevision; // incremented by each change of m_dependencyTable
+    HeaderCache m_headerCache; // shared by all source processors
+    IncludeDirCache m_includeDirCache; // as well
+
+    void removeFromSnapshot(const QString &fileName)
+    {
+        m_snapshot.remove(fileName);
+        m_dependencyTable.remove(Utils::FileName::fromString(fileName));
+        ++m_dependencyTableRevision;
+    }
 
     // Project integration
     mutable QMutex m_projectMutex;
@@ -230,7 +245,8 @@ QSet<QString> CppModelManager::timeStampModifiedFiles(const QList<Document::Ptr>
 CppSourceProcessor *CppModelManager::createSourceProcessor()
 {
     CppModelManager *that = instance();
-    return new CppSourceProcessor(that->snapshot(), [that](const Document::Ptr &doc) {
+    CppSourceProcessor *processor = new CppSourceProcessor(that->snapshot(),
+                                                           [that](const Document::Ptr &doc) {
         const Document::Ptr previousDocument = that->document(doc->fileName());
         const unsigned newRevision = previousDocument.isNull()
                 ? 1U
@@ -239,6 +255,19 @@ CppSourceProcessor *CppModelManager::createSourceProcessor()
         that->emitDocumentUpdated(doc);
         doc->releaseSourceAndAST();
     });
+    processor->setHeaderCache(that->headerCache());
+    processor->setIncludeDirCache(that->includeDirCache());
+    return processor;
+}
+
+HeaderCache *CppModelManager::headerCache() const
+{
+    return &d->m_headerCache;
+}
+
+IncludeDirCache *CppModelManager::includeDirCache() const
+{
+    return &d->m_includeDirCache;
 }
 
 QString CppModelManager::editorConfigurationFileName()
@@ -298,6 +327,7 @@ CppModelManager::CppModelManager(QObject *parent)
 {
     d->m_indexingSupporter = 0;
     d->m_enableGC = true;
+    d->m_dependencyTableRevision = 0;
 
     qRegisterMetaType<QSet<QString> >();
     connect(this, SIGNAL(sourceFilesRefreshed(QSet<QString>)),
@@ -355,6 +385,22 @@ Snapshot CppModelManager::snapshot() const
     return d->m_snapshot;
 }
 
+DependencyTable CppModelManager::dependencyTable() const
+{
+    // The closures are computed on a copy, so the snapshot stays unlocked meanwhile
+    QMutexLocker locker(&d->m_snapshotMutex);
+    DependencyTable table = d->m_dependencyTable;
+    const int revision = d->m_dependencyTableRevision;
+    locker.unlock();
+
+    table.updateClosures();
+
+    locker.relock();
+    if (revision == d->m_dependencyTableRevision)
+        d->m_dependencyTable = table;
+    return table;
+}
+
 Document::Ptr CppModelManager::document(const QString &fileName) const
 {
     QMutexLocker locker(&d->m_snapshotMutex);
@@ -374,6 +420,9 @@ bool CppModelManager::replaceDocument(Document::Ptr newDoc)
         return false;
 
     d->m_snapshot.insert(newDoc);
+    d->m_dependencyTable.insert(Utils::FileName::fromString(newDoc->fileName()),
+                                newDoc->includedFiles());
+    ++d->m_dependencyTableRevision;
     return true;
 }
 
@@ -559,6 +608,15 @@ void CppModelManager::renameMacroUsages(const Macro &macro, const QString &repla
 void CppModelManager::replaceSnapshot(const Snapshot &newSnapshot)
 {
     QMutexLocker snapshotLocker(&d->m_snapshotMutex);
+    for (Snapshot::const_iterator it = d->m_snapshot.begin(); it != d->m_snapshot.end(); ++it) {
+        if (!newSnapshot.contains(it.key()))
+            d->m_dependencyTable.remove(it.key());
+    }
+    for (Snapshot::const_iterator it = newSnapshot.begin(); it != newSnapshot.end(); ++it) {
+        if (d->m_snapshot.document(it.key()) != it.value())
+            d->m_dependencyTable.insert(it.key(), it.value()->includedFiles());
+    }
+    ++d->m_dependencyTableRevision;
     d->m_snapshot = newSnapshot;
 }
 
@@ -652,8 +710,8 @@ void CppModelManager::removeProjectInfoFilesAndIncludesFromSnapshot(const Projec
     foreach (const ProjectPart::Ptr &projectPart, projectInfo.projectParts()) {
         foreach (const ProjectFile &cxxFile, projectPart->files) {
             foreach (const QString &fileName, d->m_snapshot.allIncludesForDocument(cxxFile.path))
-                d->m_snapshot.remove(fileName);
-            d->m_snapshot.remove(cxxFile.path);
+                d->removeFromSnapshot(fileName);
+            d->removeFromSnapshot(cxxFile.path);
         }
     }
 }
@@ -678,7 +736,7 @@ void CppModelManager::removeFilesFromSnapshot(const QSet<QString> &filesToRemove
     QMutexLocker snapshotLocker(&d->m_snapshotMutex);
     QSetIterator<QString> i(filesToRemove);
     while (i.hasNext())
-        d->m_snapshot.remove(i.next());
+        d->removeFromSnapshot(i.next());
 }
 
 static QSet<QString> projectPartIds(const QSet<ProjectPart::Ptr> &projectParts)
@@ -754,6 +812,15 @@ void CppModelManager::recalculateProjectPartMappings()
 {
     d->m_projectPartIdToProjectProjectPart.clear();
     d->m_fileToProjectParts.clear();
+    // builds rewrite the files in their build directory, so the indexer must not map them
+    QStringList buildDirs;
+    foreach (const ProjectInfo &projectInfo, d->m_projectToProjectsInfo) {
+        ProjectExplorer::Project *project = projectInfo.project().data();
+        ProjectExplorer::Target *target = project ? project->activeTarget() : 0;
+        if (target && target->activeBuildConfiguration())
+            buildDirs << target->activeBuildConfiguration()->buildDirectory().toString();
+    }
+    Utils::TextFileFormat::setUnmappedDirectories(buildDirs);
     foreach (const ProjectInfo &projectInfo, d->m_projectToProjectsInfo) {
         foreach (const ProjectPart::Ptr &projectPart, projectInfo.projectParts()) {
             d->m_projectPartIdToProjectProjectPart[projectPart->id()] = projectPart;
@@ -823,7 +890,7 @@ QFuture<void> CppModelManager::updateProjectInfo(const ProjectInfo &newProjectIn
                     // The "configuration file" includes all defines and therefore should be updated
                     if (comparer.definesChanged()) {
                         QMutexLocker snapshotLocker(&d->m_snapshotMutex);
-                        d->m_snapshot.remove(configurationFileName());
+                        d->removeFromSnapshot(configurationFileName());
                     }
 
                 // Otherwise check for added and modified files
@@ -898,7 +965,7 @@ QList<ProjectPart::Ptr> CppModelManager::projectPartFromDependencies(
         const Utils::FileName &fileName) const
 {
     QSet<ProjectPart::Ptr> parts;
-    const Utils::FileNameList deps = snapshot().filesDependingOn(fileName);
+    const Utils::FileNameList deps = dependencyTable().filesDependingOn(fileName);
 
     QMutexLocker locker(&d->m_projectMutex);
     foreach (const Utils::FileName &dep, deps) {
@@ -1134,6 +1201,7 @@ void CppModelManager::GC()
     }
 
     // Announce removing files and replace the snapshot
+    d->m_headerCache.remove(notReachableFiles);
     emit aboutToRemoveFiles(notReachableFiles);
     replaceSnapshot(newSnapshot);
     emit gcFinished();
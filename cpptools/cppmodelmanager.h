@@ -64,6 +64,8 @@ class WorkingCopy;
 namespace Internal {
 class CppSourceProcessor;
 class CppModelManagerPrivate;
+class HeaderCache;
+class IncludeDirCache;
 }
 
 namespace Tests {
@@ -113,6 +115,8 @@ public:
     ProjectPart::Ptr fallbackProjectPart();
 
     CPlusPlus::Snapshot snapshot() const;
+    // the include dependencies of the snapshot, kept up to date with each document change
+    CPlusPlus::DependencyTable dependencyTable() const;
     Document::Ptr document(const QString &fileName) const;
     bool replaceDocument(Document::Ptr newDoc);
 
@@ -169,6 +173,8 @@ public:
     static QSet<QString> timeStampModifiedFiles(const QList<Document::Ptr> &documentsToCheck);
 
     static Internal::CppSourceProcessor *createSourceProcessor();
+    Internal::HeaderCache *headerCache() const;
+    Internal::IncludeDirCache *includeDirCache() const;
     static QString configurationFileName();
     static QString editorConfigurationFileName();
 
@@ -23,6 +23,7 @@
 
 #include "cppsourceprocessor.h"
 
+#include "cppincludedircache.h"
 #include "cppmodelmanager.h"
 #include "cpptoolsreuse.h"
 
@@ -33,9 +34,12 @@
 #include <utils/qtcassert.h>
 #include <utils/textfileformat.h>
 
+#include <cplusplus/PPToken.h>
+
 #include <QCoreApplication>
 #include <QCryptographicHash>
 #include <QDir>
+#include <QFile>
 #include <QLoggingCategory>
 #include <QTextCodec>
 
@@ -104,12 +108,114 @@ inline const Macro revision(const WorkingCopy &workingCopy,
     return newMacro;
 }
 
+inline bool sameDefinition(const Macro *macro, const Macro &incoming)
+{
+    const bool defined = macro && !macro->isHidden();
+    if (defined == incoming.isHidden())
+        return false;
+    return !defined || (macro->definitionText() == incoming.definitionText()
+                        && macro->formals() == incoming.formals()
+                        && macro->isFunctionLike() == incoming.isFunctionLike()
+                        && macro->isVariadic() == incoming.isVariadic());
+}
+
+inline bool isIdentifierChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Undefined identifiers in #if expressions evaluate to 0 without being reported to the client,
+// so the identifiers of all #if and #elif lines count as looked up.
+void addConditionalNames(const QByteArray &contents, QSet<QByteArray> *names)
+{
+    const char *p = contents.constData();
+    const char *end = p + contents.size();
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        while (p < eol && (*p == ' ' || *p == '\t'))
+            ++p;
+        if (p < eol && *p == '#') {
+            ++p;
+            while (p < eol && (*p == ' ' || *p == '\t'))
+                ++p;
+            if ((eol - p > 2 && qstrncmp(p, "if", 2) == 0)
+                    || (eol - p > 4 && qstrncmp(p, "elif", 4) == 0)) {
+                while (p < eol && isIdentifierChar(*p))
+                    ++p;
+                while (p < eol) {
+                    if (!isIdentifierChar(*p)) {
+                        ++p;
+                        continue;
+                    }
+                    const char *start = p;
+                    while (p < eol && isIdentifierChar(*p))
+                        ++p;
+                    if (!(*start >= '0' && *start <= '9'))
+                        names->insert(QByteArray(start, int(p - start)));
+                }
+            }
+        }
+        p = eol + 1;
+    }
+    names->remove("defined");
+}
+
 } // anonymous namespace
 
+enum { MaxCachedVariants = 4 };
+
+QList<HeaderCache::Entry> HeaderCache::entries(const QString &fileName) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.value(fileName);
+}
+
+void HeaderCache::insert(const Entry &entry)
+{
+    const QString fileName = entry.document->fileName();
+    const QDateTime lastModified = entry.files.value(fileName);
+
+    QMutexLocker locker(&m_mutex);
+    QList<Entry> &entries = m_entries[fileName];
+    // The variants of another version of the file are of no use anymore
+    for (int i = entries.size() - 1; i >= 0; --i) {
+        if (entries.at(i).files.value(fileName) != lastModified)
+            entries.removeAt(i);
+    }
+    entries.prepend(entry);
+    while (entries.size() > MaxCachedVariants)
+        entries.removeLast();
+}
+
+void HeaderCache::remove(const QStringList &fileNames)
+{
+    QMutexLocker locker(&m_mutex);
+    foreach (const QString &fileName, fileNames)
+        m_entries.remove(fileName);
+}
+
+Document::Ptr SharedDocuments::document(const QString &fileName) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_documents.value(fileName);
+}
+
+void SharedDocuments::insert(const Document::Ptr &doc)
+{
+    QMutexLocker locker(&m_mutex);
+    m_documents.insert(doc->fileName(), doc);
+}
+
 CppSourceProcessor::CppSourceProcessor(const Snapshot &snapshot, DocumentCallback documentFinished)
     : m_snapshot(snapshot),
+      m_shared(0),
+      m_headerCache(0),
+      m_includeDirCache(0),
       m_documentFinished(documentFinished),
       m_preprocess(this, &m_env),
+      m_headerPathsKey(0),
       m_languageFeatures(LanguageFeatures::defaultFeatures()),
       m_defaultCodec(Core::EditorManager::defaultTextCodec())
 {
@@ -134,6 +240,10 @@ void CppSourceProcessor::setHeaderPaths(const ProjectPart::HeaderPaths &headerPa
         else
             addFrameworkPath(path);
     }
+
+    m_headerPathsKey = 0;
+    foreach (const ProjectPart::HeaderPath &path, m_headerPaths)
+        m_headerPathsKey = m_headerPathsKey * 31 + qHash(path.path) + path.type;
 }
 
 void CppSourceProcessor::setLanguageFeatures(const LanguageFeatures languageFeatures)
@@ -196,9 +306,11 @@ void CppSourceProcessor::resetEnvironment()
     m_included.clear();
 }
 
+// The contents of a file which needs no transcoding refer to its mapping in \a mapped
 bool CppSourceProcessor::getFileContents(const QString &absoluteFilePath,
                                          QByteArray *contents,
-                                         unsigned *revision) const
+                                         unsigned *revision,
+                                         QFile *mapped) const
 {
     if (absoluteFilePath.isEmpty() || !contents || !revision)
         return false;
@@ -214,7 +326,8 @@ bool CppSourceProcessor::getFileContents(const QString &absoluteFilePath,
     // Get from file
     *revision = 0;
     QString error;
-    if (Utils::TextFileFormat::readFileUTF8(absoluteFilePath, m_defaultCodec, contents, &error)
+    mapped->setFileName(absoluteFilePath);
+    if (Utils::TextFileFormat::mapFileUTF8(mapped, m_defaultCodec, contents, &error)
             != Utils::TextFileFormat::ReadSuccess) {
         qWarning("Error reading file \"%s\": \"%s\".", qPrintable(absoluteFilePath),
                  qPrintable(error));
@@ -231,6 +344,9 @@ bool CppSourceProcessor::checkFile(const QString &absoluteFilePath) const
         return true;
     }
 
+    if (m_includeDirCache)
+        return m_includeDirCache->isFile(absoluteFilePath);
+
     const QFileInfo fileInfo(absoluteFilePath);
     return fileInfo.isFile() && fileInfo.isReadable();
 }
@@ -331,6 +447,7 @@ void CppSourceProcessor::passedMacroDefinitionCheck(unsigned bytesOffset, unsign
     if (!m_currentDoc)
         return;
 
+    lookedUp(macro.name());
     m_currentDoc->addMacroUse(revision(m_workingCopy, macro),
                               bytesOffset, macro.name().length(),
                               utf16charsOffset, macro.nameToQString().size(),
@@ -343,6 +460,7 @@ void CppSourceProcessor::failedMacroDefinitionCheck(unsigned bytesOffset, unsign
     if (!m_currentDoc)
         return;
 
+    lookedUp(QByteArray(name.start(), name.size()));
     m_currentDoc->addUndefinedMacroUse(QByteArray(name.start(), name.size()),
                                        bytesOffset, utf16charOffset);
 }
@@ -353,6 +471,7 @@ void CppSourceProcessor::notifyMacroReference(unsigned bytesOffset, unsigned utf
     if (!m_currentDoc)
         return;
 
+    lookedUp(macro.name());
     m_currentDoc->addMacroUse(revision(m_workingCopy, macro),
                               bytesOffset, macro.name().length(),
                               utf16charOffset, macro.nameToQString().size(),
@@ -366,6 +485,7 @@ void CppSourceProcessor::startExpandingMacro(unsigned bytesOffset, unsigned utf1
     if (!m_currentDoc)
         return;
 
+    lookedUp(macro.name());
     m_currentDoc->addMacroUse(revision(m_workingCopy, macro),
                               bytesOffset, macro.name().length(),
                               utf16charOffset, macro.nameToQString().size(),
@@ -397,11 +517,12 @@ void CppSourceProcessor::mergeEnvironment(Document::Ptr doc)
         return;
 
     m_processed.insert(fn);
+    noteFile(doc);
 
     foreach (const Document::Include &incl, doc->resolvedIncludes()) {
         const QString includedFile = incl.resolvedFileName();
 
-        if (Document::Ptr includedDoc = m_snapshot.document(includedFile))
+        if (Document::Ptr includedDoc = processedDocument(includedFile))
             mergeEnvironment(includedDoc);
         else if (!m_included.contains(includedFile))
             run(includedFile);
@@ -410,6 +531,17 @@ void CppSourceProcessor::mergeEnvironment(Document::Ptr doc)
     m_env.addMacros(doc->definedMacros());
 }
 
+Document::Ptr CppSourceProcessor::processedDocument(const QString &fileName)
+{
+    Document::Ptr doc = m_snapshot.document(fileName);
+    if (!doc && m_shared) {
+        doc = m_shared->document(fileName);
+        if (doc)
+            m_snapshot.insert(doc);
+    }
+    return doc;
+}
+
 void CppSourceProcessor::startSkippingBlocks(unsigned utf16charsOffset)
 {
     if (m_currentDoc)
@@ -442,20 +574,26 @@ void CppSourceProcessor::sourceNeeded(unsigned line, const QString &fileName, In
     if (!isInjectedFile(absoluteFileName))
         m_included.insert(absoluteFileName);
 
-    // Already in snapshot? Use it!
-    if (Document::Ptr document = m_snapshot.document(absoluteFileName)) {
+    // Already in snapshot or processed by another worker? Use it!
+    if (Document::Ptr document = processedDocument(absoluteFileName)) {
         mergeEnvironment(document);
         return;
     }
 
+    // Included before with the same incoming macros? Use it!
+    if (initialIncludes.isEmpty() && reuseCachedDocument(absoluteFileName))
+        return;
+
     const QFileInfo info(absoluteFileName);
     if (skipFileDueToSizeLimit(info))
         return; // TODO: Add diagnostic message
 
     // Otherwise get file contents
     unsigned editorRevision = 0;
-    QByteArray contents;
-    const bool gotFileContents = getFileContents(absoluteFileName, &contents, &editorRevision);
+    QFile file;
+    QByteArray contents; // may refer to the mapping of file, which must stay open meanwhile
+    const bool gotFileContents = getFileContents(absoluteFileName, &contents, &editorRevision,
+                                                 &file);
     if (m_currentDoc && !gotFileContents) {
         m_currentDoc->addDiagnosticMessage(messageNoFileContents(m_currentDoc, fileName, line));
         return;
@@ -474,6 +612,8 @@ void CppSourceProcessor::sourceNeeded(unsigned line, const QString &fileName, In
     if (info.exists())
         document->setLastModified(info.lastModified());
 
+    enterFile(contents, initialIncludes.isEmpty() && editorRevision == 0
+              && !isInjectedFile(absoluteFileName));
     const Document::Ptr previousDocument = switchCurrentDocument(document);
     const QByteArray preprocessedCode = m_preprocess.run(absoluteFileName, contents);
 //    {
@@ -482,13 +622,18 @@ void CppSourceProcessor::sourceNeeded(unsigned line, const QString &fileName, In
 //    }
     document->setFingerprint(generateFingerPrint(document->definedMacros(), preprocessedCode));
 
-    // Re-use document from global snapshot if possible
+    // Re-use document from global snapshot or from another worker if possible
     Document::Ptr globalDocument = m_globalSnapshot.document(absoluteFileName);
+    if (m_shared && (!globalDocument || globalDocument->fingerprint() != document->fingerprint()))
+        globalDocument = m_shared->document(absoluteFileName);
     if (globalDocument && globalDocument->fingerprint() == document->fingerprint()) {
         switchCurrentDocument(previousDocument);
         mergeEnvironment(globalDocument);
         m_snapshot.insert(globalDocument);
+        if (m_shared)
+            m_shared->insert(globalDocument);
         m_todo.remove(absoluteFileName);
+        leaveFile(globalDocument, document->lastModified());
         return;
     }
 
@@ -502,8 +647,11 @@ void CppSourceProcessor::sourceNeeded(unsigned line, const QString &fileName, In
     m_documentFinished(document);
 
     m_snapshot.insert(document);
+    if (m_shared)
+        m_shared->insert(document);
     m_todo.remove(absoluteFileName);
     switchCurrentDocument(previousDocument);
+    leaveFile(document, document->lastModified());
 }
 
 Document::Ptr CppSourceProcessor::switchCurrentDocument(Document::Ptr doc)
@@ -512,3 +660,180 @@ Document::Ptr CppSourceProcessor::switchCurrentDocument(Document::Ptr doc)
     m_currentDoc = doc;
     return previousDoc;
 }
+
+bool CppSourceProcessor::reuseCachedDocument(const QString &fileName)
+{
+    if (!m_headerCache || m_workingCopy.contains(fileName))
+        return false;
+
+    foreach (const HeaderCache::Entry &entry, m_headerCache->entries(fileName)) {
+        if (!isReusable(entry, fileName))
+            continue;
+
+        // Prefer the equivalent document of the global snapshot, it is the more recent one
+        Document::Ptr document = entry.document;
+        const Document::Ptr globalDocument = m_globalSnapshot.document(fileName);
+        if (globalDocument && globalDocument->fingerprint() == document->fingerprint())
+            document = globalDocument;
+
+        if (!m_frames.isEmpty()) {
+            Frame &frame = m_frames.last();
+            foreach (const Macro &macro, entry.incoming)
+                frame.names.insert(macro.name());
+            for (auto i = entry.files.constBegin(), ei = entry.files.constEnd(); i != ei; ++i)
+                frame.files.insert(i.key(), i.value());
+        }
+
+        qCDebug(log) << "Reusing:" << fileName;
+        mergeEnvironment(document);
+        m_snapshot.insert(document);
+        if (m_shared)
+            m_shared->insert(document);
+        m_todo.remove(fileName);
+        return true;
+    }
+    return false;
+}
+
+bool CppSourceProcessor::isReusable(const HeaderCache::Entry &entry,
+                                    const QString &fileName) const
+{
+    if (entry.headerPaths != m_headerPathsKey
+            || entry.languageFeatures != m_languageFeatures.flags) {
+        return false;
+    }
+
+    foreach (const Macro &macro, entry.incoming) {
+        const QByteArray name = macro.name();
+        if (!sameDefinition(m_env.resolve(&name), macro))
+            return false;
+    }
+
+    // The included files must be unchanged and processed again, as they were at that time
+    for (auto i = entry.files.constBegin(), ei = entry.files.constEnd(); i != ei; ++i) {
+        const QString &file = i.key();
+        if (file != fileName && (m_included.contains(file) || m_processed.contains(file)))
+            return false;
+        if (m_workingCopy.contains(file) || QFileInfo(file).lastModified() != i.value())
+            return false;
+    }
+    return true;
+}
+
+void CppSourceProcessor::enterFile(const QByteArray &contents, bool cacheable)
+{
+    Frame frame;
+    frame.macroCount = m_env.macroCount();
+    frame.cacheable = cacheable && m_headerCache;
+    if (frame.cacheable)
+        addConditionalNames(contents, &frame.names);
+    m_frames.append(frame);
+}
+
+void CppSourceProcessor::leaveFile(const Document::Ptr &doc, const QDateTime &lastModified)
+{
+    QTC_ASSERT(!m_frames.isEmpty(), return);
+    Frame frame = m_frames.takeLast();
+    frame.files.insert(doc->fileName(), lastModified);
+
+    // What the file depends on, the including file depends on as well
+    if (!m_frames.isEmpty()) {
+        Frame &parent = m_frames.last();
+        parent.names.unite(frame.names);
+        for (auto i = frame.files.constBegin(), ei = frame.files.constEnd(); i != ei; ++i)
+            parent.files.insert(i.key(), i.value());
+        parent.cacheable = parent.cacheable && frame.cacheable;
+    }
+
+    if (!frame.cacheable)
+        return;
+
+    HeaderCache::Entry entry;
+    entry.document = doc;
+    entry.incoming = incomingMacros(frame);
+    entry.files = frame.files;
+    entry.headerPaths = m_headerPathsKey;
+    entry.languageFeatures = m_languageFeatures.flags;
+    m_headerCache->insert(entry);
+}
+
+void CppSourceProcessor::lookedUp(const QByteArray &macroName)
+{
+    if (!m_frames.isEmpty())
+        m_frames.last().names.insert(macroName);
+}
+
+void CppSourceProcessor::noteFile(const Document::Ptr &doc)
+{
+    if (m_frames.isEmpty())
+        return;
+
+    Frame &frame = m_frames.last();
+    if (doc->editorRevision() != 0 || m_workingCopy.contains(doc->fileName()))
+        frame.cacheable = false;
+    else
+        frame.files.insert(doc->fileName(), doc->lastModified());
+}
+
+// The definitions the looked up macros had when the file was entered, including the macros
+// their definitions expand to. Undefined macros are returned hidden.
+QList<Macro> CppSourceProcessor::incomingMacros(const Frame &frame) const
+{
+    // The environment only grows; macros bound since entering the file shadow the incoming ones
+    QSet<QByteArray> rebound;
+    for (unsigned i = frame.macroCount, ei = m_env.macroCount(); i < ei; ++i)
+        rebound.insert(m_env.macroAt(i)->name());
+
+    QHash<QByteArray, const Macro *> incoming;
+    QSet<QByteArray> seen = frame.names;
+    QList<QByteArray> todo = frame.names.toList();
+    while (!todo.isEmpty()) {
+        QSet<QByteArray> wanted;
+        foreach (const QByteArray &name, todo) {
+            if (rebound.contains(name))
+                wanted.insert(name);
+            else
+                incoming.insert(name, m_env.resolve(&name));
+        }
+        // One backward pass finds the incoming definitions of all rebound macros
+        for (unsigned i = frame.macroCount; i > 0 && !wanted.isEmpty(); --i) {
+            const Macro *macro = m_env.macroAt(i - 1);
+            if (wanted.remove(macro->name()))
+                incoming.insert(macro->name(), macro);
+        }
+        foreach (const QByteArray &name, wanted)
+            incoming.insert(name, 0);
+
+        QList<QByteArray> next;
+        foreach (const QByteArray &name, todo) {
+            const Macro *definitions[] = { incoming.value(name), m_env.resolve(&name) };
+            for (const Macro *macro : definitions) {
+                if (!macro || macro->isHidden())
+                    continue;
+                foreach (const CPlusPlus::Internal::PPToken &token, macro->definitionTokens()) {
+                    if (!token.is(T_IDENTIFIER))
+                        continue;
+                    const QByteArray identifier = token.asByteArrayRef().toByteArray();
+                    if (!seen.contains(identifier)) {
+                        seen.insert(identifier);
+                        next.append(identifier);
+                    }
+                }
+            }
+        }
+        todo = next;
+    }
+
+    QList<Macro> result;
+    for (auto i = incoming.constBegin(), ei = incoming.constEnd(); i != ei; ++i) {
+        if (i.value() && !i.value()->isHidden()) {
+            result.append(*i.value());
+        } else {
+            Macro undefined;
+            undefined.setName(i.key());
+            undefined.setHidden(true);
+            result.append(undefined);
+        }
+    }
+    return result;
+}
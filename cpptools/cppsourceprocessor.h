@@ -37,7 +37,9 @@
 #include <cplusplus/PreprocessorEnvironment.h>
 #include <cplusplus/pp-engine.h>
 
+#include <QDateTime>
 #include <QHash>
+#include <QMutex>
 #include <QPointer>
 #include <QSet>
 #include <QStringList>
@@ -45,12 +47,51 @@
 #include <functional>
 
 QT_BEGIN_NAMESPACE
+class QFile;
 class QTextCodec;
 QT_END_NAMESPACE
 
 namespace CppTools {
 namespace Internal {
 
+class IncludeDirCache;
+
+// Documents processed by any of the source processors of a parallel indexing run,
+// so a header is processed only once however many workers include it.
+class SharedDocuments
+{
+public:
+    CPlusPlus::Document::Ptr document(const QString &fileName) const;
+    void insert(const CPlusPlus::Document::Ptr &doc);
+
+private:
+    mutable QMutex m_mutex;
+    QHash<QString, CPlusPlus::Document::Ptr> m_documents;
+};
+
+// Documents of processed files together with the incoming macro definitions they depend on,
+// so a file included again with the same definitions is neither preprocessed nor fingerprinted.
+class HeaderCache
+{
+public:
+    struct Entry
+    {
+        CPlusPlus::Document::Ptr document;
+        QList<CPlusPlus::Macro> incoming; // when the file was entered; hidden if undefined
+        QHash<QString, QDateTime> files; // the file itself and the files it included
+        uint headerPaths;
+        unsigned languageFeatures;
+    };
+
+    QList<Entry> entries(const QString &fileName) const;
+    void insert(const Entry &entry);
+    void remove(const QStringList &fileNames);
+
+private:
+    mutable QMutex m_mutex;
+    QHash<QString, QList<Entry> > m_entries;
+};
+
 // Documentation inside.
 class CppSourceProcessor: public CPlusPlus::Client
 {
@@ -78,6 +119,9 @@ public:
     const QSet<QString> &todo() const { return m_todo; }
 
     void setGlobalSnapshot(const CPlusPlus::Snapshot &snapshot) { m_globalSnapshot = snapshot; }
+    void setSharedDocuments(SharedDocuments *shared) { m_shared = shared; }
+    void setHeaderCache(HeaderCache *cache) { m_headerCache = cache; }
+    void setIncludeDirCache(IncludeDirCache *cache) { m_includeDirCache = cache; }
 
 private:
     void addFrameworkPath(const ProjectPart::HeaderPath &frameworkPath);
@@ -85,12 +129,30 @@ private:
     CPlusPlus::Document::Ptr switchCurrentDocument(CPlusPlus::Document::Ptr doc);
 
     bool getFileContents(const QString &absoluteFilePath, QByteArray *contents,
-                         unsigned *revision) const;
+                         unsigned *revision, QFile *mapped) const;
     bool checkFile(const QString &absoluteFilePath) const;
     QString resolveFile(const QString &fileName, IncludeType type);
     QString resolveFile_helper(const QString &fileName, IncludeType type);
 
     void mergeEnvironment(CPlusPlus::Document::Ptr doc);
+    CPlusPlus::Document::Ptr processedDocument(const QString &fileName);
+
+    // A file being processed and what its result depends on
+    struct Frame
+    {
+        unsigned macroCount; // of the environment when the file was entered
+        QSet<QByteArray> names; // of the macros looked up by the file and its includes
+        QHash<QString, QDateTime> files;
+        bool cacheable;
+    };
+
+    bool reuseCachedDocument(const QString &fileName);
+    bool isReusable(const HeaderCache::Entry &entry, const QString &fileName) const;
+    void enterFile(const QByteArray &contents, bool cacheable);
+    void leaveFile(const CPlusPlus::Document::Ptr &doc, const QDateTime &lastModified);
+    void lookedUp(const QByteArray &macroName);
+    void noteFile(const CPlusPlus::Document::Ptr &doc);
+    QList<CPlusPlus::Macro> incomingMacros(const Frame &frame) const;
 
     // Client interface
     void macroAdded(const CPlusPlus::Macro &macro) override;
@@ -113,10 +175,15 @@ private:
 private:
     CPlusPlus::Snapshot m_snapshot;
     CPlusPlus::Snapshot m_globalSnapshot;
+    SharedDocuments *m_shared;
+    HeaderCache *m_headerCache;
+    IncludeDirCache *m_includeDirCache;
+    QVector<Frame> m_frames;
     DocumentCallback m_documentFinished;
     CPlusPlus::Environment m_env;
     CPlusPlus::Preprocessor m_preprocess;
     ProjectPart::HeaderPaths m_headerPaths;
+    uint m_headerPathsKey;
     CPlusPlus::LanguageFeatures m_languageFeatures;
     CppTools::WorkingCopy m_workingCopy;
     QSet<QString> m_included;
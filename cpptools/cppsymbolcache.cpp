@@ -0,0 +1,211 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "cppsymbolcache.h"
+#include "stringtable.h"
+
+#include <utils/db/database.h>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QStringList>
+#include <QtDebug>
+
+using namespace CppTools;
+using namespace CppTools::Internal;
+
+enum { Version = 1 };
+
+static QVector<IndexItem::Ptr> children(const IndexItem::Ptr &item)
+{
+    QVector<IndexItem::Ptr> res;
+    item->visitAllChildren([&res](const IndexItem::Ptr &child) -> IndexItem::VisitorResult {
+        res.append(child);
+        return IndexItem::Continue;
+    });
+    return res;
+}
+
+SymbolCache::SymbolCache():m_db(0)
+{
+}
+
+SymbolCache::~SymbolCache()
+{
+    close();
+}
+
+bool SymbolCache::open(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    delete m_db;
+    m_db = new Utils::Database();
+    if (!m_db->open(path)) {
+        qWarning() << "cannot open symbol cache" << path;
+        delete m_db;
+        m_db = 0;
+        return false;
+    }
+    m_db->exec("PRAGMA synchronous=OFF");
+    m_db->exec("CREATE TABLE IF NOT EXISTS Symbols ( "
+               "Path TEXT PRIMARY KEY, "
+               "Stamp BLOB, "
+               "Items BLOB )");
+    return true;
+}
+
+void SymbolCache::close()
+{
+    QMutexLocker locker(&m_mutex);
+    delete m_db;
+    m_db = 0;
+}
+
+IndexItem::Ptr SymbolCache::load(const QString &fileName, StringTable &strings)
+{
+    const QByteArray current = stamp(fileName);
+    if (current.isEmpty())
+        return IndexItem::Ptr();
+
+    QByteArray items;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_db == 0)
+            return IndexItem::Ptr();
+        Utils::Query q(m_db, "SELECT Stamp, Items FROM Symbols WHERE Path = ?");
+        q.bind(0, fileName);
+        if (!q.next() || q.bytes(0) != current)
+            return IndexItem::Ptr();
+        items = q.bytes(1);
+    }
+
+    QDataStream in(items);
+    quint8 version;
+    qint32 count;
+    in >> version >> count;
+    // every item takes more than a byte, so a larger count can only come from a broken entry
+    if (version != Version || in.status() != QDataStream::Ok || count < 0
+            || count > items.size())
+        return IndexItem::Ptr();
+    IndexItem::Ptr root = IndexItem::create(strings.insert(fileName), count);
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+        root->addChild(read(in, strings));
+    if (in.status() != QDataStream::Ok)
+        return IndexItem::Ptr();
+    root->squeeze();
+    return root;
+}
+
+void SymbolCache::store(const QList<IndexItem::Ptr> &roots)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_db == 0 || roots.isEmpty())
+        return;
+    m_db->exec("BEGIN TRANSACTION");
+    foreach (const IndexItem::Ptr &root, roots) {
+        const QByteArray current = stamp(root->fileName());
+        if (current.isEmpty())
+            continue;
+        QByteArray items;
+        QDataStream out(&items, QIODevice::WriteOnly);
+        const QVector<IndexItem::Ptr> symbols = children(root);
+        out << quint8(Version) << qint32(symbols.size());
+        foreach (const IndexItem::Ptr &item, symbols)
+            write(out, item);
+        Utils::Query q(m_db, "INSERT OR REPLACE INTO Symbols VALUES (?, ?, ?)");
+        q.bind(0, root->fileName());
+        q.bind(1, current);
+        q.bind(2, items);
+        q.exec();
+    }
+    m_db->exec("COMMIT");
+}
+
+void SymbolCache::prune(const QAtomicInt *stop)
+{
+    QStringList paths;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_db == 0)
+            return;
+        Utils::Query q(m_db, "SELECT Path FROM Symbols");
+        while (q.next())
+            paths.append(q.text(0));
+    }
+
+    // the database is shared by all projects, so only the files which are gone are dropped
+    QStringList deleted;
+    foreach (const QString &path, paths) {
+        if (stop->load())
+            return;
+        if (!QFileInfo::exists(path))
+            deleted.append(path);
+    }
+    if (deleted.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_db == 0)
+        return;
+    m_db->exec("BEGIN TRANSACTION");
+    foreach (const QString &path, deleted) {
+        Utils::Query q(m_db, "DELETE FROM Symbols WHERE Path = ?");
+        q.bind(0, path);
+        q.exec();
+    }
+    m_db->exec("COMMIT");
+}
+
+QString SymbolCache::fileName()
+{
+    return QLatin1String("cppsymbols.db");
+}
+
+QByteArray SymbolCache::stamp(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    if (!info.exists())
+        return QByteArray();
+    return QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + ':'
+            + QByteArray::number(info.size());
+}
+
+IndexItem::Ptr SymbolCache::read(QDataStream &in, StringTable &strings) const
+{
+    QString name, type, scope, file;
+    qint8 kind;
+    qint32 line, column, iconType, count;
+    in >> name >> type >> scope >> file >> kind >> line >> column >> iconType >> count;
+    const QIcon icon = iconType >= 0
+            ? m_icons.iconForType(CPlusPlus::Icons::IconType(iconType)) : QIcon();
+    IndexItem::Ptr item = IndexItem::create(strings.insert(name), strings.insert(type),
+                                            strings.insert(scope), IndexItem::ItemType(kind),
+                                            strings.insert(file), line, column, icon, iconType);
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+        item->addChild(read(in, strings));
+    return item;
+}
+
+void SymbolCache::write(QDataStream &out, const IndexItem::Ptr &item) const
+{
+    const QVector<IndexItem::Ptr> items = children(item);
+    out << item->symbolName() << item->symbolType() << item->symbolScope() << item->fileName()
+        << qint8(item->type()) << qint32(item->line()) << qint32(item->column())
+        << qint32(item->iconType()) << qint32(items.size());
+    foreach (const IndexItem::Ptr &child, items)
+        write(out, child);
+}
@@ -0,0 +1,65 @@
+#ifndef CPPSYMBOLCACHE_H
+#define CPPSYMBOLCACHE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch) for LeanCreator
+**
+** This file is part of LeanCreator.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "indexitem.h"
+
+#include <cplusplus/Icons.h>
+
+#include <QMutex>
+
+namespace Utils { class Database; }
+
+namespace CppTools {
+namespace Internal {
+
+class StringTable;
+
+// Keeps the locator symbols of each indexed file in a database, so they are available right
+// after a restart while the files are indexed again; an entry is only used as long as the
+// modification time and size of its file are unchanged. All methods are thread-safe.
+class SymbolCache
+{
+    Q_DISABLE_COPY(SymbolCache)
+public:
+    SymbolCache();
+    ~SymbolCache();
+
+    bool open(const QString &path);
+    void close();
+
+    IndexItem::Ptr load(const QString &fileName, StringTable &strings);
+    void store(const QList<IndexItem::Ptr> &roots); // as returned by SearchSymbols
+    void prune(const QAtomicInt *stop); // removes the entries of deleted files
+
+    static QString fileName();
+
+private:
+    static QByteArray stamp(const QString &fileName);
+    IndexItem::Ptr read(QDataStream &in, StringTable &strings) const;
+    void write(QDataStream &out, const IndexItem::Ptr &item) const;
+
+    mutable QMutex m_mutex;
+    Utils::Database *m_db;
+    CPlusPlus::Icons m_icons;
+};
+
+} // namespace Internal
+} // namespace CppTools
+
+#endif // CPPSYMBOLCACHE_H
@@ -159,6 +159,16 @@ bool CppToolsPlugin::initialize(const QStringList &arguments, QString *error)
     connect(modelManager, &CppModelManager::aboutToRemoveFiles,
             locatorData, &CppLocatorData::onAboutToRemoveFiles);
 
+    connect(modelManager, &CppModelManager::projectPartsUpdated,
+            [=](ProjectExplorer::Project *project) {
+        QStringList files;
+        foreach (const ProjectPart::Ptr &part, modelManager->projectInfo(project).projectParts()) {
+            foreach (const ProjectFile &file, part->files)
+                files.append(file.path);
+        }
+        locatorData->loadCached(files);
+    });
+
     addAutoReleasedObject(locatorData);
     addAutoReleasedObject(new CppLocatorFilter(locatorData));
     addAutoReleasedObject(new CppClassesFilter(locatorData));
@@ -36,7 +36,8 @@ using namespace CppTools;
 
 IndexItem::Ptr IndexItem::create(const QString &symbolName, const QString &symbolType,
                                  const QString &symbolScope, IndexItem::ItemType type,
-                                 const QString &fileName, int line, int column, const QIcon &icon)
+                                 const QString &fileName, int line, int column, const QIcon &icon,
+                                 int iconType)
 {
     Ptr ptr(new IndexItem);
 
@@ -48,6 +49,7 @@ IndexItem::Ptr IndexItem::create(const QString &symbolName, const QString &symbo
     ptr->m_line = line;
     ptr->m_column = column;
     ptr->m_icon = icon;
+    ptr->m_iconType = iconType;
 
     return ptr;
 }
@@ -57,6 +59,7 @@ IndexItem::Ptr IndexItem::create(const QString &fileName, int sizeHint)
     Ptr ptr(new IndexItem);
 
     ptr->m_fileName = fileName;
+    ptr->m_iconType = -1;
     ptr->m_type = Declaration;
     ptr->m_line = 0;
     ptr->m_column = 0;
@@ -66,7 +66,8 @@ public:
                       const QString &fileName,
                       int line,
                       int column,
-                      const QIcon &icon);
+                      const QIcon &icon,
+                      int iconType = -1);
     static Ptr create(const QString &fileName, int sizeHint);
 
     QString scopedSymbolName() const
@@ -87,6 +88,7 @@ public:
     QString symbolScope() const { return m_symbolScope; }
     QString fileName() const { return m_fileName; }
     QIcon icon() const { return m_icon; }
+    int iconType() const { return m_iconType; } // CPlusPlus::Icons::IconType or -1
     ItemType type() const { return m_type; }
     int line() const { return m_line; }
     int column() const { return m_column; }
@@ -129,6 +131,7 @@ private:
     QString m_symbolScope;
     QString m_fileName;
     QIcon m_icon;
+    int m_iconType;
     ItemType m_type;
     int m_line;
     int m_column;
@@ -297,7 +297,8 @@ IndexItem::Ptr SearchSymbols::addChildItem(const QString &symbolName, const QStr
         m_paths.insert(symbol->fileId(), path);
     }
 
-    const QIcon icon = icons.iconForSymbol(symbol);
+    const CPlusPlus::Icons::IconType iconType = CPlusPlus::Icons::iconTypeForSymbol(symbol);
+    const QIcon icon = icons.iconForType(iconType);
     IndexItem::Ptr newItem = IndexItem::create(findOrInsert(symbolName),
                                                findOrInsert(symbolType),
                                                findOrInsert(symbolScope),
@@ -305,7 +306,8 @@ IndexItem::Ptr SearchSymbols::addChildItem(const QString &symbolName, const QStr
                                                findOrInsert(path),
                                                symbol->line(),
                                                symbol->column() - 1, // 1-based vs 0-based column
-                                               icon);
+                                               icon,
+                                               iconType);
     _parent->addChild(newItem);
     return newItem;
 }
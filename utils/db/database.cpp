@@ -18,12 +18,16 @@
 
 #include "database.h"
 #include "sqlite3.h"
+#include <QMutex>
 using namespace Utils;
 
+// databases are opened and closed by several threads
+static QMutex s_countLock;
 static int count = 0;
 
 Database::Database():db(0)
 {
+    QMutexLocker lock(&s_countLock);
     if( count == 0 )
         sqlite3_initialize();
     count++;
@@ -32,6 +36,7 @@ Database::Database():db(0)
 Database::~Database()
 {
     sqlite3_close(db);
+    QMutexLocker lock(&s_countLock);
     count--;
     if( count == 0 )
         sqlite3_shutdown();
@@ -35,6 +35,10 @@
 #include <QTextCodec>
 #include <QStringList>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QReadWriteLock>
 
 enum { debug = 0 };
 
@@ -301,6 +305,114 @@ TextFileFormat::ReadResult TextFileFormat::readFileUTF8(const QString &fileName,
     return TextFileFormat::ReadSuccess;
 }
 
+// ASCII without CR reads the same in every codec decode() could be asked to use
+static bool isPlainAscii(const QByteArray &data)
+{
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    char bits = 0;
+    for (; p != end; ++p) {
+        if (*p == '\r')
+            return false;
+        bits |= *p;
+    }
+    return (bits & 0x80) == 0;
+}
+
+struct UnmappedDirectories
+{
+    QReadWriteLock lock;
+    QStringList dirs;
+};
+
+Q_GLOBAL_STATIC(UnmappedDirectories, unmappedDirectories)
+
+// A build may truncate or rewrite a file while it is mapped, and touching a page
+// behind the new end of the file raises SIGBUS; so files which are likely written
+// by builds are copied instead.
+static bool mayChangeWhileMapped(const QString &fileName)
+{
+    const QString name = QFileInfo(fileName).fileName();
+    if (name.startsWith(QLatin1String("moc_")) || name.startsWith(QLatin1String("ui_"))
+            || name.startsWith(QLatin1String("qrc_")) || name.endsWith(QLatin1String(".moc")))
+        return true;
+    UnmappedDirectories *unmapped = unmappedDirectories();
+    QReadLocker lock(&unmapped->lock);
+    foreach (const QString &dir, unmapped->dirs) {
+        if (fileName.startsWith(dir) && fileName.size() > dir.size()
+                && fileName.at(dir.size()) == QLatin1Char('/'))
+            return true;
+    }
+    return false;
+}
+
+/*!
+    Sets the directories, typically the build directories of the open projects,
+    whose files mapFileUTF8() reads into memory instead of mapping them.
+*/
+
+void TextFileFormat::setUnmappedDirectories(const QStringList &dirs)
+{
+    UnmappedDirectories *unmapped = unmappedDirectories();
+    QWriteLocker lock(&unmapped->lock);
+    unmapped->dirs.clear();
+    foreach (const QString &dir, dirs) {
+        if (!dir.isEmpty())
+            unmapped->dirs.append(QDir::cleanPath(QDir::fromNativeSeparators(dir)));
+    }
+}
+
+/*!
+    Reads a text file into a UTF-8 QByteArray like readFileUTF8(), but maps the file into memory.
+    If the contents need no transcoding, which is the case for UTF-8 and for plain ASCII files
+    without CR, \a plainText refers to the mapped memory without a copy and is only valid as
+    long as \a file is open. Like the data of any QByteArray it is followed by a null byte.
+    Generated files and files in the directories passed to setUnmappedDirectories() are read
+    like readFileUTF8() does, because a build truncating a mapped file makes the reader crash.
+*/
+
+TextFileFormat::ReadResult TextFileFormat::mapFileUTF8(QFile *file,
+                                                       const QTextCodec *defaultCodec,
+                                                       QByteArray *plainText,
+                                                       QString *errorString)
+{
+    if (!file->isOpen() && !file->open(QIODevice::ReadOnly)) {
+        *errorString = QCoreApplication::translate("Utils::TextFileFormat",
+                                                   "Cannot open %1 for reading: %2")
+                .arg(QDir::toNativeSeparators(file->fileName()), file->errorString());
+        return TextFileFormat::ReadIOError;
+    }
+    const qint64 size = file->size();
+    if (size == 0) {
+        plainText->clear();
+        return TextFileFormat::ReadSuccess;
+    }
+    const uchar *mapped = size < 0x7fffffff && !mayChangeWhileMapped(file->fileName())
+            ? file->map(0, size) : 0;
+    if (!mapped) // e.g. not a regular file or written by builds
+        return readFileUTF8(file->fileName(), defaultCodec, plainText, errorString);
+
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(size));
+    TextFileFormat format = TextFileFormat::detect(data);
+    if (!format.codec)
+        format.codec = defaultCodec ? defaultCodec : QTextCodec::codecForLocale();
+    if (format.hasUtf8Bom)
+        data = QByteArray::fromRawData(data.constData() + 3, data.size() - 3);
+    QString target;
+    if (format.codec->name() == "UTF-8" || isPlainAscii(data) || !format.decode(data, &target)) {
+        // The lexers rely on a terminating '\0'. The rest of the last page of a mapping is
+        // zero filled, but a file filling its last page has nothing behind it, so copy it;
+        // pages are multiples of 4096 bytes.
+        if (size % 4096 == 0)
+            *plainText = QByteArray(data.constData(), data.size());
+        else
+            *plainText = data;
+        return TextFileFormat::ReadSuccess;
+    }
+    *plainText = target.toUtf8();
+    return TextFileFormat::ReadSuccess;
+}
+
 /*!
     Writes out a text file.
 */
@@ -38,6 +38,7 @@ class QTextCodec;
 class QStringList;
 class QString;
 class QByteArray;
+class QFile;
 QT_END_NAMESPACE
 
 namespace Utils {
@@ -79,6 +80,9 @@ public:
                                QByteArray *decodingErrorSample = 0);
     static ReadResult readFileUTF8(const QString &fileName, const QTextCodec *defaultCodec,
                                    QByteArray *plainText, QString *errorString);
+    static ReadResult mapFileUTF8(QFile *file, const QTextCodec *defaultCodec,
+                                  QByteArray *plainText, QString *errorString);
+    static void setUnmappedDirectories(const QStringList &dirs);
 
     bool writeFile(const QString &fileName, QString plainText, QString *errorString) const;
 